@@ -0,0 +1,85 @@
+//
+//  BoxCarAutotuner.h
+//  ImageSlicing
+//
+//  Created by Tom on 19/09/2016.
+//
+//
+
+#ifndef BoxCarAutotuner_h
+#define BoxCarAutotuner_h
+
+#include <string>
+#include <vector>
+
+// One way of running BoxCarSmoothFilter, as picked by BoxCarAutotuner
+struct BoxCarConfiguration
+{
+    enum Strategy
+    {
+        SingleThreaded = 0,
+        WorkStealing = 1,
+        ZSlabs = 2
+    };
+
+    Strategy Method;
+    unsigned int NumberOfThreads;
+    unsigned int VoxelsPerTask;
+
+    // Best calibration time, for the record
+    double Milliseconds;
+
+    static const char* GetStrategyName( Strategy method );
+};
+
+/**
+ * Works out which BoxCarSmoothFilter strategy (single threaded, work stealing with various thread counts and
+ * task sizes, or one Z slab per thread) is quickest on this machine, by timing each of them a few times on a
+ * synthetic sub-volume, and remembers the answer in a small per-host file so that only the first run pays for
+ * it. The file is ignored (and rewritten) if the number of cores has changed since.
+ *
+ * USE_THREADED_IMPLEMENTATION changes what the filter class is, so that stays a build-time choice; this picks
+ * between everything that can be switched at run time.
+ */
+template< typename TImage >
+class BoxCarAutotuner
+{
+public:
+
+    typedef typename TImage::PixelType PixelType;
+
+    BoxCarAutotuner();
+
+    // Defaults to ~/.ImageSlicing-boxcar-<host name>.cfg
+    void SetConfigFileName( const std::string& fileName ) { this->ConfigFileName = fileName; }
+    const std::string& GetConfigFileName() const { return this->ConfigFileName; }
+
+    // Size of the calibration volume, 256 x 256 x 48 to start with
+    void SetCalibrationSize( unsigned int nx, unsigned int ny, unsigned int nz );
+
+    // The cached configuration if there is a usable one, otherwise Calibrate() and cache the result
+    BoxCarConfiguration GetConfiguration( bool recalibrate = false );
+
+    // Time every candidate and return the quickest
+    BoxCarConfiguration Calibrate();
+
+    // The candidates Calibrate() tries, for this many cores
+    static std::vector< BoxCarConfiguration > GetCandidates( unsigned int cores );
+
+    // Set the filter up to run that way
+    template< typename TFilter >
+    static void Apply( const BoxCarConfiguration& configuration, TFilter* filter );
+
+    bool ReadConfiguration( BoxCarConfiguration& configuration ) const;
+    bool WriteConfiguration( const BoxCarConfiguration& configuration ) const;
+
+private:
+
+    std::string ConfigFileName;
+    unsigned int CalibrationSize[3];
+    unsigned int NumberOfCores;
+};
+
+#include "BoxCarAutotuner.hxx"
+
+#endif /* BoxCarAutotuner_h */
@@ -0,0 +1,263 @@
+//
+//  BoxCarAutotuner.hxx
+//  ImageSlicing
+//
+//  Created by Tom on 19/09/2016.
+//
+//
+
+#ifndef BoxCarAutotuner_hxx
+#define BoxCarAutotuner_hxx
+
+#include "BoxCarAutotuner.h"
+#include "BoxCarSmoothFilter.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+#include <unistd.h>
+
+inline const char* BoxCarConfiguration::GetStrategyName( Strategy method )
+{
+    switch ( method )
+    {
+        case WorkStealing: return "work-stealing";
+        case ZSlabs: return "z-slabs";
+        default: return "single-threaded";
+    }
+}
+
+template< typename TImage >
+BoxCarAutotuner< TImage >::BoxCarAutotuner()
+{
+    this->NumberOfCores = std::max( 1u, std::thread::hardware_concurrency() );
+    this->SetCalibrationSize( 256, 256, 48 );
+
+    // Per host, so that a home directory shared between machines still gets each one its own answer
+    char host[256] = "localhost";
+    gethostname( host, sizeof( host ) - 1 );
+    host[sizeof( host ) - 1] = '\0';
+    const char* home = std::getenv( "HOME" );
+    this->ConfigFileName = std::string( home ? home : "." ) + "/.ImageSlicing-boxcar-" + host + ".cfg";
+}
+
+template< typename TImage >
+void BoxCarAutotuner< TImage >::SetCalibrationSize( unsigned int nx, unsigned int ny, unsigned int nz )
+{
+    // Big enough to have an interior to speak of
+    this->CalibrationSize[0] = std::max( 8u, nx );
+    this->CalibrationSize[1] = std::max( 8u, ny );
+    this->CalibrationSize[2] = std::max( 8u, nz );
+}
+
+template< typename TImage >
+BoxCarConfiguration BoxCarAutotuner< TImage >::GetConfiguration( bool recalibrate )
+{
+    BoxCarConfiguration configuration;
+    if ( !recalibrate && this->ReadConfiguration( configuration ) )
+    {
+        std::cout << "Box car filter: " << BoxCarConfiguration::GetStrategyName( configuration.Method ) << ", "
+                  << configuration.NumberOfThreads << " threads (from " << this->ConfigFileName << ")" << std::endl;
+        return configuration;
+    }
+
+    configuration = this->Calibrate();
+    if ( this->WriteConfiguration( configuration ) )
+    {
+        std::cout << "Saved box car filter configuration to " << this->ConfigFileName << std::endl;
+    }
+    return configuration;
+}
+
+template< typename TImage >
+std::vector< BoxCarConfiguration > BoxCarAutotuner< TImage >::GetCandidates( unsigned int cores )
+{
+    std::vector< BoxCarConfiguration > candidates;
+    BoxCarConfiguration single = { BoxCarConfiguration::SingleThreaded, 1, 1 << 16, 0.0 };
+    candidates.push_back( single );
+
+    // Every core, and half of them (which can win when memory bandwidth runs out first, or with SMT)
+    std::vector< unsigned int > threadCounts;
+    if ( cores > 1 )
+    {
+        threadCounts.push_back( cores );
+    }
+    if ( cores / 2 > 1 )
+    {
+        threadCounts.push_back( cores / 2 );
+    }
+
+    for ( unsigned int threads : threadCounts )
+    {
+        for ( unsigned int voxelsPerTask : { 1u << 14, 1u << 16, 1u << 18 } )
+        {
+            BoxCarConfiguration stealing = { BoxCarConfiguration::WorkStealing, threads, voxelsPerTask, 0.0 };
+            candidates.push_back( stealing );
+        }
+        BoxCarConfiguration slabs = { BoxCarConfiguration::ZSlabs, threads, 1 << 16, 0.0 };
+        candidates.push_back( slabs );
+    }
+    return candidates;
+}
+
+template< typename TImage >
+BoxCarConfiguration BoxCarAutotuner< TImage >::Calibrate()
+{
+    typedef std::chrono::steady_clock Clock;
+
+    // Something CT-like: air round the outside, noisy soft tissue in an elliptical body
+    typename TImage::Pointer image = TImage::New();
+    typename TImage::RegionType region;
+    region.SetSize( 0, this->CalibrationSize[0] );
+    region.SetSize( 1, this->CalibrationSize[1] );
+    region.SetSize( 2, this->CalibrationSize[2] );
+    image->SetRegions( region );
+    image->Allocate();
+
+    PixelType* voxel = image->GetBufferPointer();
+    unsigned int random = 12345;
+    const double cx = 0.5 * this->CalibrationSize[0], cy = 0.5 * this->CalibrationSize[1];
+    for ( unsigned int z = 0; z < this->CalibrationSize[2]; ++z )
+    {
+        for ( unsigned int y = 0; y < this->CalibrationSize[1]; ++y )
+        {
+            for ( unsigned int x = 0; x < this->CalibrationSize[0]; ++x, ++voxel )
+            {
+                random = random * 1664525u + 1013904223u;
+                const double dx = ( x - cx ) / ( 0.45 * this->CalibrationSize[0] ), dy = ( y - cy ) / ( 0.35 * this->CalibrationSize[1] );
+                const int noise = static_cast< int >( random >> 24 ) - 128;
+                *voxel = static_cast< PixelType >( dx * dx + dy * dy < 1.0 ? 40 + noise : -1000 + noise / 8 );
+            }
+        }
+    }
+
+    // Same inset request as TgwSlicer
+    typename TImage::RegionType insetRegion = region;
+    insetRegion.ShrinkByRadius( 1 );
+
+    std::vector< BoxCarConfiguration > candidates = GetCandidates( this->NumberOfCores );
+    std::cout << "Calibrating the box car filter on " << this->CalibrationSize[0] << "x" << this->CalibrationSize[1]
+              << "x" << this->CalibrationSize[2] << " voxels" << std::endl;
+
+    std::size_t best = 0;
+    for ( std::size_t c = 0; c < candidates.size(); ++c )
+    {
+        typedef BoxCarSmoothFilter< TImage > FilterType;
+        typename FilterType::Pointer filter = FilterType::New();
+        filter->SetInput( image );
+        filter->ReportTimingOff();
+        Apply( candidates[c], filter.GetPointer() );
+        filter->GetOutput()->SetRequestedRegion( insetRegion );
+
+        // The first run starts the threads and faults the output in, so it doesn't count
+        filter->Update();
+        double fastest = 0.0;
+        for ( int run = 0; run < 3; ++run )
+        {
+            filter->Modified();
+            const Clock::time_point start = Clock::now();
+            filter->Update();
+            const double milliseconds = std::chrono::duration< double, std::milli >( Clock::now() - start ).count();
+            fastest = ( run == 0 ) ? milliseconds : std::min( fastest, milliseconds );
+        }
+        candidates[c].Milliseconds = fastest;
+
+        std::cout << "  " << BoxCarConfiguration::GetStrategyName( candidates[c].Method ) << ", " << candidates[c].NumberOfThreads
+                  << " threads, " << candidates[c].VoxelsPerTask << " voxels per task: " << fastest << " ms" << std::endl;
+        if ( fastest < candidates[best].Milliseconds || c == 0 )
+        {
+            best = c;
+        }
+    }
+
+    std::cout << "Using " << BoxCarConfiguration::GetStrategyName( candidates[best].Method ) << " with "
+              << candidates[best].NumberOfThreads << " threads" << std::endl;
+    return candidates[best];
+}
+
+template< typename TImage >
+template< typename TFilter >
+void BoxCarAutotuner< TImage >::Apply( const BoxCarConfiguration& configuration, TFilter* filter )
+{
+    filter->SetUseWorkStealing( configuration.Method == BoxCarConfiguration::WorkStealing );
+    filter->SetUseNumaPlacement( configuration.Method == BoxCarConfiguration::ZSlabs );
+    filter->SetNumberOfThreads( std::max( 1u, configuration.NumberOfThreads ) );
+    filter->SetVoxelsPerTask( configuration.VoxelsPerTask );
+}
+
+template< typename TImage >
+bool BoxCarAutotuner< TImage >::ReadConfiguration( BoxCarConfiguration& configuration ) const
+{
+    std::ifstream file( this->ConfigFileName.c_str() );
+    if ( !file )
+    {
+        return false;
+    }
+
+    // "key value" lines, anything after a # ignored
+    unsigned int cores = 0;
+    bool haveStrategy = false;
+    configuration.NumberOfThreads = 1;
+    configuration.VoxelsPerTask = 1 << 16;
+    configuration.Milliseconds = 0.0;
+    std::string line;
+    while ( std::getline( file, line ) )
+    {
+        std::istringstream fields( line.substr( 0, line.find( '#' ) ) );
+        std::string key, value;
+        if ( !( fields >> key >> value ) )
+        {
+            continue;
+        }
+        if ( key == "cores" )
+        {
+            cores = static_cast< unsigned int >( std::strtoul( value.c_str(), nullptr, 10 ) );
+        }
+        else if ( key == "strategy" )
+        {
+            for ( int method = BoxCarConfiguration::SingleThreaded; method <= BoxCarConfiguration::ZSlabs; ++method )
+            {
+                if ( value == BoxCarConfiguration::GetStrategyName( static_cast< BoxCarConfiguration::Strategy >( method ) ) )
+                {
+                    configuration.Method = static_cast< BoxCarConfiguration::Strategy >( method );
+                    haveStrategy = true;
+                }
+            }
+        }
+        else if ( key == "threads" )
+        {
+            configuration.NumberOfThreads = static_cast< unsigned int >( std::strtoul( value.c_str(), nullptr, 10 ) );
+        }
+        else if ( key == "voxels-per-task" )
+        {
+            configuration.VoxelsPerTask = static_cast< unsigned int >( std::strtoul( value.c_str(), nullptr, 10 ) );
+        }
+        else if ( key == "milliseconds" )
+        {
+            configuration.Milliseconds = std::strtod( value.c_str(), nullptr );
+        }
+    }
+
+    // Calibrated on different hardware (or a different VM size), so start again
+    return haveStrategy && cores == this->NumberOfCores && configuration.NumberOfThreads > 0 && configuration.VoxelsPerTask > 0;
+}
+
+template< typename TImage >
+bool BoxCarAutotuner< TImage >::WriteConfiguration( const BoxCarConfiguration& configuration ) const
+{
+    std::ofstream file( this->ConfigFileName.c_str() );
+    file << "# BoxCarSmoothFilter configuration picked by calibration; delete to recalibrate" << std::endl;
+    file << "cores " << this->NumberOfCores << std::endl;
+    file << "strategy " << BoxCarConfiguration::GetStrategyName( configuration.Method ) << std::endl;
+    file << "threads " << configuration.NumberOfThreads << std::endl;
+    file << "voxels-per-task " << configuration.VoxelsPerTask << std::endl;
+    file << "milliseconds " << configuration.Milliseconds << std::endl;
+    return static_cast< bool >( file );
+}
+
+#endif /* BoxCarAutotuner_hxx */
@@ -0,0 +1,105 @@
+//
+//  BoxCarKernel.h
+//  ImageSlicing
+//
+//  Created by Tom on 16/08/2016.
+//
+//
+
+#ifndef BoxCarKernel_h
+#define BoxCarKernel_h
+
+#include <cstddef>
+
+/**
+ * Raw-pointer version of the 3x3x3 box-car average, for the places where we are handed buffers rather than
+ * ITK images (or where the neighbourhood iterator is too slow). For integer pixel types the results are
+ * bit-for-bit the same as BoxCarSmoothFilter, which sums in floating point and then divides by 27.
+ */
+
+// Integer pixel types can be summed exactly in an int, which is a lot quicker than float
+template< typename TPixel > struct BoxCarAccumulator { typedef float Type; };
+template<> struct BoxCarAccumulator< signed short > { typedef int Type; };
+template<> struct BoxCarAccumulator< unsigned short > { typedef int Type; };
+template<> struct BoxCarAccumulator< signed char > { typedef int Type; };
+template<> struct BoxCarAccumulator< unsigned char > { typedef int Type; };
+
+/**
+ * Smooth count consecutive voxels along a row. below/centre/above point at the first voxel of the row in the
+ * slices z-1, z and z+1 (which don't need to be contiguous), and rowStride is the distance in pixels between
+ * rows within a slice. The voxels either side of the row, and the rows either side, must all exist.
+ */
+template< typename TPixel >
+inline void BoxCarSmoothRow( const TPixel* below, const TPixel* centre, const TPixel* above,
+                             std::ptrdiff_t rowStride, TPixel* output, std::size_t count )
+{
+    typedef typename BoxCarAccumulator< TPixel >::Type AccumulatorType;
+
+    // Sum each 3x3 column (in y and z) once, then slide a window of three columns along the row
+    const TPixel* planes[3] = { below, centre, above };
+    AccumulatorType columns[3];
+    for ( int c = 0; c < 2; ++c )
+    {
+        AccumulatorType sum = 0;
+        for ( int p = 0; p < 3; ++p )
+        {
+            sum += planes[p][c - 1 - rowStride] + planes[p][c - 1] + planes[p][c - 1 + rowStride];
+        }
+        columns[c] = sum;
+    }
+
+    for ( std::size_t i = 0; i < count; ++i )
+    {
+        AccumulatorType next = 0;
+        for ( int p = 0; p < 3; ++p )
+        {
+            const TPixel* column = planes[p] + i + 1;
+            next += column[-rowStride] + column[0] + column[rowStride];
+        }
+        const AccumulatorType sum = columns[0] + columns[1] + next;
+        output[i] = static_cast< TPixel >( static_cast< float >( sum ) / 27.0f );
+        columns[0] = columns[1];
+        columns[1] = next;
+    }
+}
+
+/**
+ * Smooth a whole row j (all nx voxels) of a slice, where below/centre/above point at the start of the slices
+ * z-1, z and z+1, each a contiguous nx x ny plane. Anything off the edge of the planes is clamped to the
+ * nearest voxel, which is what the neighbourhood iterator's default (zero-flux Neumann) boundary condition
+ * does. For the first and last slice just pass the same plane twice.
+ */
+template< typename TPixel >
+inline void BoxCarSmoothClampedRow( const TPixel* below, const TPixel* centre, const TPixel* above,
+                                    std::size_t nx, std::size_t ny, std::size_t j, TPixel* output )
+{
+    typedef typename BoxCarAccumulator< TPixel >::Type AccumulatorType;
+
+    const std::size_t previousRow = ( j > 0 ? j - 1 : 0 ) * nx;
+    const std::size_t currentRow = j * nx;
+    const std::size_t nextRow = ( j + 1 < ny ? j + 1 : j ) * nx;
+    const TPixel* planes[3] = { below, centre, above };
+
+    auto column = [&]( std::size_t i ) -> AccumulatorType
+    {
+        AccumulatorType sum = 0;
+        for ( int p = 0; p < 3; ++p )
+        {
+            sum += planes[p][previousRow + i] + planes[p][currentRow + i] + planes[p][nextRow + i];
+        }
+        return sum;
+    };
+
+    AccumulatorType left = column( 0 );
+    AccumulatorType middle = left;
+    for ( std::size_t i = 0; i < nx; ++i )
+    {
+        const AccumulatorType right = ( i + 1 < nx ) ? column( i + 1 ) : middle;
+        const AccumulatorType sum = left + middle + right;
+        output[i] = static_cast< TPixel >( static_cast< float >( sum ) / 27.0f );
+        left = middle;
+        middle = right;
+    }
+}
+
+#endif /* BoxCarKernel_h */
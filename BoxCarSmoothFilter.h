@@ -9,45 +9,140 @@
 #ifndef BoxCarSmoothFilter_hpp
 #define BoxCarSmoothFilter_hpp
 
-#include <itkImageToImageFilter.h>
+#include <itkInPlaceImageFilter.h>
+
+#include "IntensityHistogram.h"
 
 // Forward declarations
 namespace itk
 {
     class TimeProbe;
 }
+class WorkStealingExecutor;
 
 #define USE_THREADED_IMPLEMENTATION 0
 
 /**
  * Simple box-car filter implementation using a 3x3x3 voxel kernel.
+ *
+ * It can also run in place (InPlaceOn(), off by default), overwriting its input slice by slice and keeping
+ * only the original copies of the last two slices. For that the output requested region has to match the
+ * input's buffered region, otherwise ITK quietly allocates a separate output as usual.
  */
 template< typename TImage >
-class BoxCarSmoothFilter : public itk::ImageToImageFilter< TImage, TImage >
+class BoxCarSmoothFilter : public itk::InPlaceImageFilter< TImage, TImage >
 {
 public:
     
     typedef BoxCarSmoothFilter Self;
-    typedef itk::ImageToImageFilter<TImage,TImage> Superclass;
+    typedef itk::InPlaceImageFilter<TImage,TImage> Superclass;
     typedef itk::SmartPointer<Self> Pointer;
     typedef itk::SmartPointer<const Self> ConstPointer;
     
     /** Superclass typedefs. */
     typedef typename Superclass::OutputImageRegionType OutputImageRegionType;
+    typedef typename TImage::PixelType PixelType;
 
     /** Method for creation through the object factory. */
     itkNewMacro(Self);
     
     /** Run-time type information (and related methods). */
-    itkTypeMacro(BoxCarSmoothFilter, itk::ImageToImageFilter);
+    itkTypeMacro(BoxCarSmoothFilter, itk::InPlaceImageFilter);
     
     // Optional method for output
     void PrintSelf( std::ostream& os, itk::Indent indent ) const;
 
+    // We need a one voxel halo around the requested output region, so ask upstream for that (and only that)
+    // rather than the whole input. This lets a streaming reader decode just the slab we are filtering.
+    virtual void GenerateInputRequestedRegion() ITK_OVERRIDE;
+
+    // Split the interior and the faces into small row/slab tasks and run them on a work-stealing pool of
+    // GetNumberOfThreads() workers, rather than processing the faces one after another on this thread
+    itkSetMacro(UseWorkStealing, bool);
+    itkGetConstMacro(UseWorkStealing, bool);
+    itkBooleanMacro(UseWorkStealing);
+    
+    // Roughly how many voxels go in each work-stealing task (rounded to whole rows)
+    itkSetMacro(VoxelsPerTask, unsigned int);
+    itkGetConstMacro(VoxelsPerTask, unsigned int);
+    
+    // Split the output into one Z slab per thread, with each thread pinned to a core on the memory node that
+    // holds its slab. Falls back to plain threads on single-node machines.
+    itkSetMacro(UseNumaPlacement, bool);
+    itkGetConstMacro(UseNumaPlacement, bool);
+    itkBooleanMacro(UseNumaPlacement);
+    
+    // Empty-space skipping. The output is cut into bricks of BrickSize^3 voxels, and any brick whose input
+    // (including the one voxel halo) is entirely at or below EmptyThreshold isn't filtered, but just filled
+    // with EmptyBrickValue. Everywhere else the output is exactly what full filtering would give. Handy for
+    // the air around the patient in CT (e.g. threshold -500, value -1000). This runs on the work-stealing pool
+    // if UseWorkStealing is on, and takes priority over UseNumaPlacement, which is then ignored (with a warning).
+    itkSetMacro(SkipEmptyBricks, bool);
+    itkGetConstMacro(SkipEmptyBricks, bool);
+    itkBooleanMacro(SkipEmptyBricks);
+    itkSetMacro(EmptyThreshold, PixelType);
+    itkGetConstMacro(EmptyThreshold, PixelType);
+    itkSetMacro(EmptyBrickValue, PixelType);
+    itkGetConstMacro(EmptyBrickValue, PixelType);
+    itkSetMacro(BrickSize, unsigned int);
+    itkGetConstMacro(BrickSize, unsigned int);
+    
+    // Take the output buffer from VolumeBufferPool::GetGlobalPool(), and give it back when the output is
+    // re-initialised, so re-running the filter (another series of the same size, say) reuses the same memory
+    itkSetMacro(UseBufferPool, bool);
+    itkGetConstMacro(UseBufferPool, bool);
+    itkBooleanMacro(UseBufferPool);
+    
+    // Histogram the output as it's written (per thread, merged at the end), for choosing a window/level
+    // without another pass over the volume. Whatever the method, every output voxel is counted once.
+    itkSetMacro(ComputeHistogram, bool);
+    itkGetConstMacro(ComputeHistogram, bool);
+    itkBooleanMacro(ComputeHistogram);
+    
+    // From the last update with ComputeHistogram on
+    const IntensityHistogram& GetHistogram() const { return this->m_Histogram; }
+    
+    // Print how long each update took (on by default)
+    itkSetMacro(ReportTiming, bool);
+    itkGetConstMacro(ReportTiming, bool);
+    itkBooleanMacro(ReportTiming);
+
 #if !USE_THREADED_IMPLEMENTATION
     // Because we need neighbouring pixels to do the processing, we'll create our own implementation
     // of this method.
     virtual void GenerateData() ITK_OVERRIDE;
+    
+    // The original single threaded implementation, with the neighbourhood iterator
+    void GenerateDataSingleThreaded();
+    
+    // Overwrite the (grafted) input buffer slice by slice with a rolling copy of the last two input slices
+    void GenerateDataInPlace();
+    
+    // Smooth one region of the output using the neighbourhood iterator (which handles the boundaries)
+    void SmoothRegion( const TImage* input, TImage* output, const OutputImageRegionType& region ) const;
+    
+    // Smooth a region where the whole kernel is inside the input buffer, using the raw row kernel
+    void SmoothInteriorRegion( const TImage* input, TImage* output, const OutputImageRegionType& region ) const;
+    
+    // Split a region into its interior and faces, and use whichever of the above suits each one
+    void SmoothRegionWithFaces( const TImage* input, TImage* output, const OutputImageRegionType& region ) const;
+    
+    // Smooth the interior face in rows using the raw kernel, and everything else with SmoothRegion, as tasks
+    // for the work-stealing pool
+    void GenerateDataWithWorkStealing();
+    
+    // One Z slab per pinned thread, see SetUseNumaPlacement
+    void GenerateDataNumaAware();
+    
+    // One task per brick, which works out whether it's occupied and then filters or fills it, see
+    // SetSkipEmptyBricks. Uses the work-stealing pool as well if that is switched on.
+    void GenerateDataSkippingEmptyBricks();
+    
+    // Whether any voxel of the input in region is above EmptyThreshold
+    bool RegionHasTissue( const TImage* input, const OutputImageRegionType& region ) const;
+    
+    // The pool for the work-stealing modes, (re)created to match GetNumberOfThreads()
+    WorkStealingExecutor* GetExecutor();
 #else
     virtual void BeforeThreadedGenerateData() ITK_OVERRIDE;
     virtual void AfterThreadedGenerateData() ITK_OVERRIDE;
@@ -56,8 +151,11 @@ public:
     
 protected:
     
-    BoxCarSmoothFilter() {};
-    virtual ~BoxCarSmoothFilter() {};
+    BoxCarSmoothFilter();
+    virtual ~BoxCarSmoothFilter();
+    
+    // Puts a pooled pixel container on the output first when UseBufferPool is on (and we're not in place)
+    virtual void AllocateOutputs() ITK_OVERRIDE;
     
 private:
     
@@ -65,6 +163,20 @@ private:
     void operator=(const Self &) ITK_DELETE_FUNCTION;
     
     itk::TimeProbe* clock;
+    
+    bool m_UseWorkStealing;
+    unsigned int m_VoxelsPerTask;
+    bool m_UseNumaPlacement;
+    bool m_SkipEmptyBricks;
+    PixelType m_EmptyThreshold;
+    PixelType m_EmptyBrickValue;
+    unsigned int m_BrickSize;
+    bool m_UseBufferPool;
+    bool m_ComputeHistogram;
+    IntensityHistogram m_Histogram;
+    mutable ThreadLocalHistograms m_ThreadHistograms;
+    bool m_ReportTiming;
+    WorkStealingExecutor* m_Executor;
 };
 
 #ifndef ITK_MANUAL_INSTANTIATION
@@ -10,6 +10,10 @@
 #define BoxCarSmoothFilter_hxx
 
 #include "BoxCarSmoothFilter.h"
+#include "BoxCarKernel.h"
+#include "NumaTopology.h"
+#include "PooledImageContainer.h"
+#include "WorkStealingExecutor.h"
 
 #include "itkNeighborhoodIterator.h"
 #include "itkImageIterator.h"
@@ -17,10 +21,71 @@
 #include "itkConstantBoundaryCondition.h"
 #include "itkNeighborhoodAlgorithm.h"
 
+#include <algorithm>
+#include <vector>
+
+template< typename TImage >
+BoxCarSmoothFilter< TImage >::BoxCarSmoothFilter()
+: clock( nullptr ), m_UseWorkStealing( false ), m_VoxelsPerTask( 1 << 16 ), m_UseNumaPlacement( false ), m_SkipEmptyBricks( false ),
+  m_EmptyThreshold( itk::NumericTraits< PixelType >::NonpositiveMin() ),
+  m_EmptyBrickValue( itk::NumericTraits< PixelType >::NonpositiveMin() ),
+  m_BrickSize( 16 ), m_UseBufferPool( false ), m_ComputeHistogram( false ), m_ReportTiming( true ),
+  m_Executor( nullptr )
+{
+    // InPlaceImageFilter defaults to in place, but only GenerateData() knows how to do that
+    this->InPlaceOff();
+}
+
+template< typename TImage >
+BoxCarSmoothFilter< TImage >::~BoxCarSmoothFilter()
+{
+    delete this->m_Executor;
+}
+
 template< typename TImage >
 void BoxCarSmoothFilter< TImage >::PrintSelf( std::ostream& os, itk::Indent indent ) const
 {
     os << "I am a box-car filter using a 3x3x3 voxel kernel, ignoring the outer edge of voxels" << std::endl;
+    os << indent << "UseWorkStealing: " << this->m_UseWorkStealing << " (" << this->m_VoxelsPerTask << " voxels per task)" << std::endl;
+    os << indent << "UseNumaPlacement: " << this->m_UseNumaPlacement << std::endl;
+    os << indent << "SkipEmptyBricks: " << this->m_SkipEmptyBricks << " (threshold " << this->m_EmptyThreshold
+       << ", fill " << this->m_EmptyBrickValue << ", brick size " << this->m_BrickSize << ")" << std::endl;
+    os << indent << "UseBufferPool: " << this->m_UseBufferPool << std::endl;
+    os << indent << "ComputeHistogram: " << this->m_ComputeHistogram << std::endl;
+    os << indent << "ReportTiming: " << this->m_ReportTiming << std::endl;
+}
+
+template< typename TImage >
+void BoxCarSmoothFilter< TImage >::AllocateOutputs()
+{
+    // PrepareOutputs() has already swapped the output's old container for an empty one (sending the old
+    // buffer back to the pool), so this picks it up again when the size hasn't changed
+    if ( this->m_UseBufferPool && !( this->GetInPlace() && this->CanRunInPlace() ) )
+    {
+        typedef PooledImageContainer< itk::SizeValueType, PixelType > PooledContainerType;
+        typename PooledContainerType::Pointer container = PooledContainerType::New();
+        this->GetOutput()->SetPixelContainer( container );
+    }
+    Superclass::AllocateOutputs();
+}
+
+template< typename TImage >
+void BoxCarSmoothFilter< TImage >::GenerateInputRequestedRegion()
+{
+    Superclass::GenerateInputRequestedRegion();
+    
+    typename TImage::Pointer input = const_cast< TImage* >( this->GetInput() );
+    if ( !input )
+    {
+        return;
+    }
+    
+    // Pad by the kernel radius, then crop to what actually exists. Voxels on the edge of the volume are
+    // handled by the boundary condition of the neighbourhood iterator.
+    typename TImage::RegionType inputRequestedRegion = input->GetRequestedRegion();
+    inputRequestedRegion.PadByRadius( 1 );
+    inputRequestedRegion.Crop( input->GetLargestPossibleRegion() );
+    input->SetRequestedRegion( inputRequestedRegion );
 }
 
 #if !USE_THREADED_IMPLEMENTATION
@@ -35,6 +100,57 @@ void BoxCarSmoothFilter< TImage >::GenerateData()
     typename TImage::Pointer output = this->GetOutput();
     
     this->AllocateOutputs();
+    
+    this->m_Histogram.Clear();
+    
+    // If the input was grafted on to the output, we have to be careful not to overwrite voxels we still need
+    const char* method = "";
+    if ( input->GetBufferPointer() == output->GetBufferPointer() )
+    {
+        this->GenerateDataInPlace();
+        method = " (in place)";
+    }
+    else if ( this->m_SkipEmptyBricks )
+    {
+        if ( this->m_UseNumaPlacement )
+        {
+            itkWarningMacro( << "UseNumaPlacement is ignored while SkipEmptyBricks is on" );
+        }
+        this->GenerateDataSkippingEmptyBricks();
+        method = " (skipping empty bricks)";
+    }
+    else if ( this->m_UseNumaPlacement )
+    {
+        this->GenerateDataNumaAware();
+        method = " (NUMA slabs)";
+    }
+    else if ( this->m_UseWorkStealing )
+    {
+        this->GenerateDataWithWorkStealing();
+        method = " (work stealing)";
+    }
+    else
+    {
+        this->GenerateDataSingleThreaded();
+    }
+    
+    if ( this->m_ComputeHistogram )
+    {
+        this->m_ThreadHistograms.MergeInto( this->m_Histogram );
+    }
+    
+    clock.Stop();
+    if ( this->m_ReportTiming )
+    {
+        std::cout << "Total time for box car filtering" << method << ": " << clock.GetTotal() << std::endl;
+    }
+}
+
+template< typename TImage >
+void BoxCarSmoothFilter< TImage >::GenerateDataSingleThreaded()
+{
+    typename TImage::ConstPointer input = this->GetInput();
+    typename TImage::Pointer output = this->GetOutput();
 
 #define USE_NEIGHBOURHOOD_ITERATOR 1
 #if USE_NEIGHBOURHOOD_ITERATOR
@@ -53,25 +169,11 @@ void BoxCarSmoothFilter< TImage >::GenerateData()
     faceList = faceCalculator(input, output->GetRequestedRegion(), radius);
     typename FaceCalculatorType::FaceListType::iterator fit;
     
-    // Normal iterator for iterating over the output
-    typedef itk::ImageRegionIterator< TImage > IteratorType;
-    
     // Now loop! First over the list of regions we got by splitting our volume into the different faces
     for ( fit=faceList.begin(); fit != faceList.end(); ++fit)
     {
         // Now for each of those face regions, do the same processing
-        NeighborhoodIteratorType inputIt(radius, input, *fit);
-        IteratorType outputIt( output, *fit);
-        for (inputIt.GoToBegin(), outputIt.GoToBegin(); ! inputIt.IsAtEnd(); ++inputIt, ++outputIt)
-        {
-            float accumulator = 0;
-            for ( int kk = 0; kk < inputIt.Size(); ++kk )
-            {
-                accumulator += inputIt.GetPixel( kk );
-            }
-            const typename TImage::PixelType filteredValue = static_cast< typename TImage::PixelType >( accumulator /= inputIt.Size() );
-            outputIt.Set( filteredValue );
-        }
+        this->SmoothRegion( input, output, *fit );
     }
     
 #else
@@ -115,9 +217,371 @@ void BoxCarSmoothFilter< TImage >::GenerateData()
         }
     }
 #endif
+}
+
+template< typename TImage >
+void BoxCarSmoothFilter< TImage >::GenerateDataInPlace()
+{
+    TImage* output = this->GetOutput();
+    PixelType* volume = output->GetBufferPointer();
     
-    clock.Stop();
-    std::cout << "Total time for box car filtering: " << clock.GetTotal() << std::endl;
+    // Running in place means the requested region is the whole buffer, so the slices are contiguous
+    const typename TImage::SizeType size = output->GetBufferedRegion().GetSize();
+    const std::size_t nx = size[0];
+    const std::size_t ny = size[1];
+    const std::size_t nz = size[2];
+    const std::size_t planeSize = nx * ny;
+    if ( planeSize == 0 || nz == 0 )
+    {
+        return;
+    }
+    
+    // Original values of slices z-1 and z. Slice z+1 hasn't been written yet, so can be read straight from
+    // the volume. Off the ends we clamp (the same as the neighbourhood iterator) by reusing slice z.
+    std::vector< PixelType > previous( volume, volume + planeSize );
+    std::vector< PixelType > current( previous );
+    IntensityHistogram* histogram = this->m_ComputeHistogram ? &this->m_ThreadHistograms.Local() : nullptr;
+    
+    for ( std::size_t z = 0; z < nz; ++z )
+    {
+        PixelType* slice = volume + z * planeSize;
+        const PixelType* above = ( z + 1 < nz ) ? slice + planeSize : &current[0];
+        for ( std::size_t j = 0; j < ny; ++j )
+        {
+            BoxCarSmoothClampedRow( &previous[0], &current[0], above, nx, ny, j, slice + j * nx );
+            if ( histogram )
+            {
+                histogram->AddRow( slice + j * nx, nx );
+            }
+        }
+        
+        previous.swap( current );
+        if ( z + 1 < nz )
+        {
+            std::copy( slice + planeSize, slice + 2 * planeSize, current.begin() );
+        }
+    }
+}
+
+template< typename TImage >
+void BoxCarSmoothFilter< TImage >::SmoothRegion( const TImage* input, TImage* output, const OutputImageRegionType& region ) const
+{
+    typedef itk::ConstNeighborhoodIterator< TImage > NeighborhoodIteratorType;
+    typename NeighborhoodIteratorType::RadiusType radius;
+    radius.Fill(1);
+    
+    // Normal iterator for iterating over the output
+    typedef itk::ImageRegionIterator< TImage > IteratorType;
+    
+    NeighborhoodIteratorType inputIt(radius, input, region);
+    IteratorType outputIt( output, region);
+    IntensityHistogram* histogram = this->m_ComputeHistogram ? &this->m_ThreadHistograms.Local() : nullptr;
+    for (inputIt.GoToBegin(), outputIt.GoToBegin(); ! inputIt.IsAtEnd(); ++inputIt, ++outputIt)
+    {
+        float accumulator = 0;
+        for ( int kk = 0; kk < inputIt.Size(); ++kk )
+        {
+            accumulator += inputIt.GetPixel( kk );
+        }
+        const typename TImage::PixelType filteredValue = static_cast< typename TImage::PixelType >( accumulator /= inputIt.Size() );
+        outputIt.Set( filteredValue );
+        if ( histogram )
+        {
+            histogram->Add( static_cast< int >( filteredValue ) );
+        }
+    }
+}
+
+template< typename TImage >
+void BoxCarSmoothFilter< TImage >::SmoothInteriorRegion( const TImage* input, TImage* output, const OutputImageRegionType& region ) const
+{
+    typedef typename TImage::PixelType PixelType;
+    
+    const typename TImage::IndexType start = region.GetIndex();
+    const typename TImage::SizeType size = region.GetSize();
+    const itk::OffsetValueType rowStride = input->GetOffsetTable()[1];
+    const itk::OffsetValueType sliceStride = input->GetOffsetTable()[2];
+    
+    // The histogram is added up from each row while it's still in cache
+    IntensityHistogram* histogram = this->m_ComputeHistogram ? &this->m_ThreadHistograms.Local() : nullptr;
+    
+    typename TImage::IndexType index = start;
+    for ( itk::IndexValueType k = start[2]; k < start[2] + static_cast< itk::IndexValueType >( size[2] ); ++k )
+    {
+        index[2] = k;
+        for ( itk::IndexValueType j = start[1]; j < start[1] + static_cast< itk::IndexValueType >( size[1] ); ++j )
+        {
+            index[1] = j;
+            const PixelType* in = input->GetBufferPointer() + input->ComputeOffset( index );
+            PixelType* out = output->GetBufferPointer() + output->ComputeOffset( index );
+            BoxCarSmoothRow( in - sliceStride, in, in + sliceStride, rowStride, out, size[0] );
+            if ( histogram )
+            {
+                histogram->AddRow( out, size[0] );
+            }
+        }
+    }
+}
+
+template< typename TImage >
+void BoxCarSmoothFilter< TImage >::GenerateDataWithWorkStealing()
+{
+    const TImage* input = this->GetInput();
+    TImage* output = this->GetOutput();
+    
+    typename TImage::SizeType radius;
+    radius.Fill(1);
+    typedef itk::NeighborhoodAlgorithm::ImageBoundaryFacesCalculator< TImage > FaceCalculatorType;
+    FaceCalculatorType faceCalculator;
+    typename FaceCalculatorType::FaceListType faceList = faceCalculator(input, output->GetRequestedRegion(), radius);
+    typename FaceCalculatorType::FaceListType::iterator fit = faceList.begin();
+    
+    // Small enough that there are plenty of tasks to go round, big enough that the queueing doesn't matter
+    const itk::SizeValueType voxelsPerTask = std::max( 1u, this->m_VoxelsPerTask );
+    std::vector< WorkStealingExecutor::TaskType > tasks;
+    
+    // The first region from the face calculator is the interior, where the whole kernel is always inside the
+    // buffer. That's nearly all of the work, so cut it into blocks of rows and use the raw kernel.
+    if ( fit != faceList.end() && fit->GetNumberOfPixels() > 0 )
+    {
+        const typename TImage::IndexType start = fit->GetIndex();
+        const typename TImage::SizeType size = fit->GetSize();
+        const itk::IndexValueType rowsPerTask = std::max< itk::IndexValueType >( 1, voxelsPerTask / size[0] );
+        const itk::IndexValueType rowEnd = start[1] + size[1];
+        
+        for ( itk::IndexValueType k = start[2]; k < start[2] + static_cast< itk::IndexValueType >( size[2] ); ++k )
+        {
+            for ( itk::IndexValueType j0 = start[1]; j0 < rowEnd; j0 += rowsPerTask )
+            {
+                OutputImageRegionType rows = *fit;
+                rows.SetIndex( 1, j0 );
+                rows.SetSize( 1, std::min( j0 + rowsPerTask, rowEnd ) - j0 );
+                rows.SetIndex( 2, k );
+                rows.SetSize( 2, 1 );
+                tasks.push_back( [=]() { this->SmoothInteriorRegion( input, output, rows ); } );
+            }
+        }
+    }
+    if ( fit != faceList.end() )
+    {
+        ++fit;
+    }
+    
+    // The faces are thin but all different shapes, so chop each one up along its longest side
+    for ( ; fit != faceList.end(); ++fit )
+    {
+        const OutputImageRegionType face = *fit;
+        if ( face.GetNumberOfPixels() == 0 )
+        {
+            continue;
+        }
+        
+        unsigned int longest = 0;
+        for ( unsigned int d = 1; d < TImage::ImageDimension; ++d )
+        {
+            if ( face.GetSize()[d] > face.GetSize()[longest] )
+            {
+                longest = d;
+            }
+        }
+        const itk::SizeValueType length = face.GetSize()[longest];
+        const itk::SizeValueType linesPerTask = std::max< itk::SizeValueType >( 1, voxelsPerTask / ( face.GetNumberOfPixels() / length ) );
+        
+        for ( itk::SizeValueType offset = 0; offset < length; offset += linesPerTask )
+        {
+            OutputImageRegionType piece = face;
+            piece.SetIndex( longest, face.GetIndex()[longest] + offset );
+            piece.SetSize( longest, std::min( linesPerTask, length - offset ) );
+            tasks.push_back( [=]() { this->SmoothRegion( input, output, piece ); } );
+        }
+    }
+    
+    this->GetExecutor()->Run( tasks );
+}
+
+template< typename TImage >
+WorkStealingExecutor* BoxCarSmoothFilter< TImage >::GetExecutor()
+{
+    // Keep the pool between updates, so we don't pay for starting the threads every time
+    const unsigned int numberOfThreads = this->GetNumberOfThreads();
+    if ( !this->m_Executor || this->m_Executor->GetNumberOfThreads() != numberOfThreads )
+    {
+        delete this->m_Executor;
+        this->m_Executor = new WorkStealingExecutor( numberOfThreads );
+    }
+    return this->m_Executor;
+}
+
+template< typename TImage >
+void BoxCarSmoothFilter< TImage >::SmoothRegionWithFaces( const TImage* input, TImage* output, const OutputImageRegionType& region ) const
+{
+    typename TImage::SizeType radius;
+    radius.Fill(1);
+    typedef itk::NeighborhoodAlgorithm::ImageBoundaryFacesCalculator< TImage > FaceCalculatorType;
+    FaceCalculatorType faceCalculator;
+    typename FaceCalculatorType::FaceListType faceList = faceCalculator(input, region, radius);
+    for ( typename FaceCalculatorType::FaceListType::iterator fit = faceList.begin(); fit != faceList.end(); ++fit )
+    {
+        // The first one is always the interior
+        if ( fit == faceList.begin() )
+        {
+            this->SmoothInteriorRegion( input, output, *fit );
+        }
+        else
+        {
+            this->SmoothRegion( input, output, *fit );
+        }
+    }
+}
+
+template< typename TImage >
+bool BoxCarSmoothFilter< TImage >::RegionHasTissue( const TImage* input, const OutputImageRegionType& region ) const
+{
+    const typename TImage::IndexType start = region.GetIndex();
+    const typename TImage::SizeType size = region.GetSize();
+    const PixelType threshold = this->m_EmptyThreshold;
+    
+    typename TImage::IndexType index = start;
+    for ( itk::IndexValueType k = start[2]; k < start[2] + static_cast< itk::IndexValueType >( size[2] ); ++k )
+    {
+        index[2] = k;
+        for ( itk::IndexValueType j = start[1]; j < start[1] + static_cast< itk::IndexValueType >( size[1] ); ++j )
+        {
+            index[1] = j;
+            const PixelType* row = input->GetBufferPointer() + input->ComputeOffset( index );
+            if ( std::any_of( row, row + size[0], [threshold]( PixelType value ) { return value > threshold; } ) )
+            {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+template< typename TImage >
+void BoxCarSmoothFilter< TImage >::GenerateDataSkippingEmptyBricks()
+{
+    const TImage* input = this->GetInput();
+    TImage* output = this->GetOutput();
+    const OutputImageRegionType requestedRegion = output->GetRequestedRegion();
+    const typename TImage::IndexType start = requestedRegion.GetIndex();
+    const typename TImage::SizeType size = requestedRegion.GetSize();
+    const itk::SizeValueType brickSize = std::max( 1u, this->m_BrickSize );
+    
+    // Cut the requested region up into bricks (the ones on the far edges may be smaller)
+    std::vector< OutputImageRegionType > bricks;
+    for ( itk::SizeValueType bz = 0; bz < size[2]; bz += brickSize )
+    {
+        for ( itk::SizeValueType by = 0; by < size[1]; by += brickSize )
+        {
+            for ( itk::SizeValueType bx = 0; bx < size[0]; bx += brickSize )
+            {
+                OutputImageRegionType brick;
+                brick.SetIndex( 0, start[0] + bx );
+                brick.SetIndex( 1, start[1] + by );
+                brick.SetIndex( 2, start[2] + bz );
+                brick.SetSize( 0, std::min( brickSize, size[0] - bx ) );
+                brick.SetSize( 1, std::min( brickSize, size[1] - by ) );
+                brick.SetSize( 2, std::min( brickSize, size[2] - bz ) );
+                bricks.push_back( brick );
+            }
+        }
+    }
+    
+    // A brick needs filtering if there is anything other than air within reach of the kernel, i.e. in the brick
+    // plus a one voxel halo. (That covers the "and its neighbours" part exactly, without having to filter the
+    // whole of every neighbouring brick.) Each brick is classified in the same task that then filters or fills
+    // it: the scan stops at the first voxel of tissue, so an occupied brick is filtered straight after the few
+    // rows that were looked at, while they're still in cache, and an empty one isn't read again.
+    std::vector< char > occupied( bricks.size(), 0 );
+    const PixelType emptyValue = this->m_EmptyBrickValue;
+    auto process = [&]( std::size_t b )
+    {
+        const OutputImageRegionType& brick = bricks[b];
+        OutputImageRegionType reach = brick;
+        reach.PadByRadius( 1 );
+        reach.Crop( input->GetBufferedRegion() );
+        if ( this->RegionHasTissue( input, reach ) )
+        {
+            occupied[b] = 1;
+            this->SmoothRegionWithFaces( input, output, brick );
+            return;
+        }
+        if ( this->m_ComputeHistogram )
+        {
+            this->m_ThreadHistograms.Local().Add( static_cast< int >( emptyValue ), brick.GetNumberOfPixels() );
+        }
+        typename TImage::IndexType index = brick.GetIndex();
+        for ( itk::IndexValueType k = brick.GetIndex()[2]; k < brick.GetIndex()[2] + static_cast< itk::IndexValueType >( brick.GetSize()[2] ); ++k )
+        {
+            index[2] = k;
+            for ( itk::IndexValueType j = brick.GetIndex()[1]; j < brick.GetIndex()[1] + static_cast< itk::IndexValueType >( brick.GetSize()[1] ); ++j )
+            {
+                index[1] = j;
+                std::fill_n( output->GetBufferPointer() + output->ComputeOffset( index ), brick.GetSize()[0], emptyValue );
+            }
+        }
+    };
+    
+    if ( this->m_UseWorkStealing )
+    {
+        std::vector< WorkStealingExecutor::TaskType > tasks;
+        for ( std::size_t b = 0; b < bricks.size(); ++b )
+        {
+            tasks.push_back( [&process, b]() { process( b ); } );
+        }
+        this->GetExecutor()->Run( tasks );
+    }
+    else
+    {
+        for ( std::size_t b = 0; b < bricks.size(); ++b )
+        {
+            process( b );
+        }
+    }
+    
+    if ( this->m_ReportTiming )
+    {
+        const std::size_t occupiedBricks = std::count( occupied.begin(), occupied.end(), 1 );
+        std::cout << "Filtered " << occupiedBricks << " of " << bricks.size() << " bricks" << std::endl;
+    }
+}
+
+template< typename TImage >
+void BoxCarSmoothFilter< TImage >::GenerateDataNumaAware()
+{
+    const TImage* input = this->GetInput();
+    TImage* output = this->GetOutput();
+    
+    const OutputImageRegionType requestedRegion = output->GetRequestedRegion();
+    const itk::IndexValueType zBegin = requestedRegion.GetIndex()[2];
+    const itk::IndexValueType zEnd = zBegin + requestedRegion.GetSize()[2];
+    
+    // Split the input's range (the output's plus the halo), exactly as the reader did, and write the part of
+    // each slab that is in the output
+    const typename TImage::RegionType inputRegion = input->GetRequestedRegion();
+    const itk::IndexValueType inputBegin = inputRegion.GetIndex()[2];
+    const itk::IndexValueType inputEnd = inputBegin + inputRegion.GetSize()[2];
+    const unsigned int numberOfWorkers = NumaTopology::GetNumberOfSlabs( this->GetNumberOfThreads(), inputEnd - inputBegin );
+    
+    // Each worker gets a fixed Z slab and is pinned to a core on the node that slab's memory should live on.
+    // The output has only been allocated, not written, so the worker's writes are the first touch and pull
+    // the pages onto its node. If the reader used the same split (DicomSlabSeriesReader::SetUseNumaPlacement)
+    // the input slab is already there too, and only the slices either side of a slab come from another node.
+    NumaTopology::Get().RunPinned( numberOfWorkers, [&]( unsigned int worker )
+    {
+        long slabBegin, slabEnd;
+        NumaTopology::GetSlab( inputBegin, inputEnd, zBegin, zEnd, worker, numberOfWorkers, slabBegin, slabEnd );
+        if ( slabEnd <= slabBegin )
+        {
+            return;
+        }
+        
+        OutputImageRegionType slab = requestedRegion;
+        slab.SetIndex( 2, slabBegin );
+        slab.SetSize( 2, slabEnd - slabBegin );
+        this->SmoothRegionWithFaces( input, output, slab );
+    } );
 }
 
 #else
@@ -127,13 +591,21 @@ void BoxCarSmoothFilter< TImage >::BeforeThreadedGenerateData()
 {
     this->clock = new itk::TimeProbe();
     this->clock->Start();
+    this->m_Histogram.Clear();
 }
 
 template< typename TImage >
 void BoxCarSmoothFilter< TImage >::AfterThreadedGenerateData()
 {
+    if ( this->m_ComputeHistogram )
+    {
+        this->m_ThreadHistograms.MergeInto( this->m_Histogram );
+    }
     this->clock->Stop();
-    std::cout << "Total time for box car filtering (threaded): " << this->clock->GetTotal() << std::endl;
+    if ( this->m_ReportTiming )
+    {
+        std::cout << "Total time for box car filtering (threaded): " << this->clock->GetTotal() << std::endl;
+    }
     delete this->clock;
     this->clock = nullptr;
 }
@@ -162,6 +634,8 @@ void BoxCarSmoothFilter< TImage >::ThreadedGenerateData( const OutputImageRegion
     typedef itk::ImageRegionIterator< TImage > IteratorType;
     IteratorType outputIt( output, outputRegionForThread);
 
+    IntensityHistogram* histogram = this->m_ComputeHistogram ? &this->m_ThreadHistograms.Local() : nullptr;
+
     // Now loop!
     for ( inputIt.GoToBegin(), outputIt.GoToBegin(); !inputIt.IsAtEnd(); ++inputIt, ++outputIt )
     {
@@ -172,6 +646,10 @@ void BoxCarSmoothFilter< TImage >::ThreadedGenerateData( const OutputImageRegion
         }
         const typename TImage::PixelType filteredValue = static_cast< typename TImage::PixelType >( accumulator /= inputIt.Size() );
         outputIt.Set( filteredValue );
+        if ( histogram )
+        {
+            histogram->Add( static_cast< int >( filteredValue ) );
+        }
     }
 }
 
@@ -0,0 +1,244 @@
+//
+//  CinePlayer.cpp
+//  ImageSlicing
+//
+//  Created by Tom on 12/09/2016.
+//
+//
+
+#include "CinePlayer.h"
+
+#include "vtkImageMapToColors.h"
+#include "vtkImageReslice.h"
+#include "vtkMatrix4x4.h"
+#include "vtkRenderWindowInteractor.h"
+
+#include "SliceRenderer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+CinePlayer::CinePlayer()
+{
+    this->Reslice = 0;
+    this->Display = 0;
+    this->Interactor = 0;
+    this->TimerId = -1;
+    this->FirstSlice = 0;
+    this->NumberOfSlices = 1;
+    this->FrameRate = 30.0;
+    this->RingBufferSize = 16;
+    this->Playing = false;
+    this->FramesShown = 0;
+    this->DroppedFrames = 0;
+    this->ClockStartFrame = 0;
+    this->NextFrame = 0;
+    this->LastShownFrame = 0;
+    this->Stopping = false;
+}
+
+CinePlayer::~CinePlayer()
+{
+    this->Stop();
+}
+
+void CinePlayer::SetFrameRate( double framesPerSecond )
+{
+    {
+        std::lock_guard< std::mutex > lock( this->Mutex );
+        if ( this->Playing )
+        {
+            // Carry on from the frame that's due now, at the new rate
+            this->ClockStartFrame = this->DueFrameLocked();
+            this->ClockStart = Clock::now();
+        }
+        this->FrameRate = std::max( framesPerSecond, 1.0 );
+    }
+
+    // The timer ticks at twice the frame rate, so it has to be made again
+    if ( this->Playing && this->Interactor )
+    {
+        if ( this->TimerId >= 0 )
+        {
+            this->Interactor->DestroyTimer( this->TimerId );
+        }
+        this->TimerId = this->Interactor->CreateRepeatingTimer( std::max( 1, static_cast< int >( 500.0 / this->FrameRate ) ) );
+    }
+}
+
+void CinePlayer::Start( vtkImageReslice* reslice, vtkImageSlabProjection* slabProjection, vtkImageMapToColors* colors,
+                        vtkImageData* display, vtkRenderWindowInteractor* interactor )
+{
+    if ( this->Playing )
+    {
+        return;
+    }
+
+    this->Reslice = reslice;
+    this->Display = display;
+    this->Interactor = interactor;
+    this->Renderer.reset( new SliceRenderer( reslice, slabProjection, colors ) );
+
+    // How far the volume goes either side of the current slice, in slices along the normal
+    vtkMatrix4x4* matrix = reslice->GetResliceAxes();
+    double center[3], normal[3];
+    for ( int i = 0; i < 16; ++i )
+    {
+        this->StartAxes[i] = matrix->GetElement( i / 4, i % 4 );
+    }
+    for ( int i = 0; i < 3; ++i )
+    {
+        center[i] = matrix->GetElement( i, 3 );
+        normal[i] = matrix->GetElement( i, 2 );
+        this->Step[i] = normal[i] * this->Renderer->GetSliceSpacing();
+    }
+
+    double bounds[6];
+    vtkImageData::SafeDownCast( reslice->GetInput() )->GetBounds( bounds );
+    double nearest = 0.0, furthest = 0.0;
+    for ( int corner = 0; corner < 8; ++corner )
+    {
+        double distance = 0.0;
+        for ( int i = 0; i < 3; ++i )
+        {
+            distance += ( bounds[2 * i + ( ( corner >> i ) & 1 )] - center[i] ) * normal[i];
+        }
+        nearest = std::min( nearest, distance );
+        furthest = std::max( furthest, distance );
+    }
+    this->FirstSlice = static_cast< long long >( std::ceil( nearest / this->Renderer->GetSliceSpacing() ) );
+    this->NumberOfSlices = static_cast< long long >( std::floor( furthest / this->Renderer->GetSliceSpacing() ) ) - this->FirstSlice + 1;
+
+    // Frame 0 is the slice already on screen
+    this->Ring.clear();
+    this->PlayStart = this->ClockStart = Clock::now();
+    this->ClockStartFrame = 0;
+    this->NextFrame = 1;
+    this->LastShownFrame = 0;
+    this->FramesShown = 0;
+    this->DroppedFrames = 0;
+    this->Stopping = false;
+    this->Playing = true;
+
+    this->Producer = std::thread( &CinePlayer::Produce, this );
+    this->TimerId = interactor->CreateRepeatingTimer( std::max( 1, static_cast< int >( 500.0 / this->FrameRate ) ) );
+}
+
+void CinePlayer::Stop()
+{
+    if ( !this->Playing )
+    {
+        return;
+    }
+
+    long long due;
+    {
+        std::lock_guard< std::mutex > lock( this->Mutex );
+        this->Stopping = true;
+        due = this->DueFrameLocked();
+    }
+    this->SpaceAvailable.notify_all();
+    this->Producer.join();
+    this->Interactor->DestroyTimer( this->TimerId );
+    this->TimerId = -1;
+    this->Playing = false;
+
+    // Anything that was due before the one we're stopping on never made it either
+    this->DroppedFrames += static_cast< std::size_t >( std::max( 0LL, due - this->LastShownFrame - 1 ) );
+    this->Ring.clear();
+    this->Renderer.reset();
+
+    const double seconds = std::chrono::duration< double >( Clock::now() - this->PlayStart ).count();
+    std::cout << "Cine: " << this->FramesShown << " frames in " << seconds << " s (" << this->FramesShown / seconds
+              << " fps, asked for " << this->FrameRate << "), " << this->DroppedFrames << " dropped" << std::endl;
+}
+
+void CinePlayer::OnTimer( int timerId )
+{
+    if ( !this->Playing || timerId != this->TimerId )
+    {
+        return;
+    }
+
+    // The newest finished frame that's due; anything older than that is too late now
+    Frame frame;
+    frame.Number = -1;
+    {
+        std::lock_guard< std::mutex > lock( this->Mutex );
+        const long long due = this->DueFrameLocked();
+        while ( !this->Ring.empty() && this->Ring.front().Number <= due )
+        {
+            frame = this->Ring.front();
+            this->Ring.pop_front();
+        }
+        if ( frame.Number > this->LastShownFrame )
+        {
+            this->DroppedFrames += static_cast< std::size_t >( frame.Number - this->LastShownFrame - 1 );
+            this->LastShownFrame = frame.Number;
+            ++this->FramesShown;
+        }
+        else
+        {
+            frame.Number = -1;
+        }
+    }
+    this->SpaceAvailable.notify_one();
+
+    if ( frame.Number < 0 )
+    {
+        return;
+    }
+
+    // Show it, and leave the axes there so slicing by hand carries on from it
+    double axes[16];
+    this->FrameAxes( frame.Number, axes );
+    vtkMatrix4x4* matrix = this->Reslice->GetResliceAxes();
+    matrix->SetElement( 0, 3, axes[3] );
+    matrix->SetElement( 1, 3, axes[7] );
+    matrix->SetElement( 2, 3, axes[11] );
+    this->Display->ShallowCopy( frame.Image );
+    this->Display->Modified();
+    this->Interactor->Render();
+}
+
+long long CinePlayer::DueFrameLocked() const
+{
+    const double seconds = std::chrono::duration< double >( Clock::now() - this->ClockStart ).count();
+    return this->ClockStartFrame + static_cast< long long >( seconds * this->FrameRate );
+}
+
+void CinePlayer::FrameAxes( long long frame, double axes[16] ) const
+{
+    const long long slice = this->FirstSlice + ( frame - this->FirstSlice ) % this->NumberOfSlices;
+    std::copy( this->StartAxes, this->StartAxes + 16, axes );
+    axes[3] += slice * this->Step[0];
+    axes[7] += slice * this->Step[1];
+    axes[11] += slice * this->Step[2];
+}
+
+void CinePlayer::Produce()
+{
+    std::unique_lock< std::mutex > lock( this->Mutex );
+    for ( ;; )
+    {
+        this->SpaceAvailable.wait( lock, [this] { return this->Stopping || this->Ring.size() < this->RingBufferSize; } );
+        if ( this->Stopping )
+        {
+            return;
+        }
+
+        // If we've fallen behind there's no point making frames that are already late
+        Frame frame;
+        frame.Number = std::max( this->NextFrame, this->DueFrameLocked() );
+        double axes[16];
+        this->FrameAxes( frame.Number, axes );
+
+        lock.unlock();
+        frame.Image = this->Renderer->Render( axes );
+        lock.lock();
+
+        this->Ring.push_back( frame );
+        this->NextFrame = frame.Number + 1;
+    }
+}
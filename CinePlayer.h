@@ -0,0 +1,124 @@
+//
+//  CinePlayer.h
+//  ImageSlicing
+//
+//  Created by Tom on 12/09/2016.
+//
+//
+
+#ifndef CinePlayer_h
+#define CinePlayer_h
+
+#include "vtkSmartPointer.h"
+#include "vtkImageData.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+class SliceRenderer;
+class vtkImageMapToColors;
+class vtkImageReslice;
+class vtkImageSlabProjection;
+class vtkRenderWindowInteractor;
+
+/**
+ * Cine playback: steps the reslice axes one slice at a time along their normal through the whole volume
+ * (starting from the slice on screen and wrapping round at the far end) at a fixed frame rate, in whatever
+ * orientation is being viewed.
+ *
+ * A producer thread with its own copy of the pipeline (see SliceRenderer) keeps a ring buffer of the next
+ * finished slices full, and a repeating interactor timer, ticking at twice the frame rate, shows whichever
+ * frame the clock says is due. A frame whose time passes before it was shown counts as dropped; when the
+ * producer falls behind it skips straight to the frame that is due, rather than playing in slow motion.
+ *
+ * Everything here apart from the producer is for the UI thread (the one running the interactor).
+ */
+class CinePlayer
+{
+public:
+
+    CinePlayer();
+    ~CinePlayer();
+
+    // Frames (slices) per second, 30 to start with. Can be changed while playing.
+    void SetFrameRate( double framesPerSecond );
+    double GetFrameRate() const { return this->FrameRate; }
+
+    // How many finished slices the producer may get ahead by
+    void SetRingBufferSize( std::size_t frames ) { this->RingBufferSize = frames; }
+
+    // Start from the current slice of the pipeline on screen (which must have been updated at least once).
+    // Frames are shown by shallow copying them into display, the image the actor shows.
+    void Start( vtkImageReslice* reslice, vtkImageSlabProjection* slabProjection, vtkImageMapToColors* colors,
+                vtkImageData* display, vtkRenderWindowInteractor* interactor );
+
+    // Stop on the last slice shown (which the reslice axes are left at), and print the frame counts
+    void Stop();
+
+    bool IsPlaying() const { return this->Playing; }
+
+    // For the interactor's TimerEvent; ignores other timers
+    void OnTimer( int timerId );
+
+    std::size_t GetNumberOfFramesShown() const { return this->FramesShown; }
+    std::size_t GetNumberOfDroppedFrames() const { return this->DroppedFrames; }
+
+private:
+
+    CinePlayer( const CinePlayer& );
+    void operator=( const CinePlayer& );
+
+    typedef std::chrono::steady_clock Clock;
+
+    struct Frame
+    {
+        long long Number;
+        vtkSmartPointer<vtkImageData> Image;
+    };
+
+    // The frame that should be on screen now. Mutex held.
+    long long DueFrameLocked() const;
+
+    // Reslice axes for a frame
+    void FrameAxes( long long frame, double axes[16] ) const;
+
+    void Produce();
+
+    vtkImageReslice* Reslice;
+    vtkImageData* Display;
+    vtkRenderWindowInteractor* Interactor;
+    int TimerId;
+
+    // Where frame 0 is, which way is forward, and how many slices fit before wrapping round
+    double StartAxes[16];
+    double Step[3];
+    long long FirstSlice;
+    long long NumberOfSlices;
+
+    double FrameRate;
+    std::size_t RingBufferSize;
+    // Only changed on the UI thread, but atomic so it can be asked about from anywhere
+    std::atomic< bool > Playing;
+    std::size_t FramesShown;
+    std::size_t DroppedFrames;
+
+    std::mutex Mutex;
+    std::condition_variable SpaceAvailable;
+    std::deque< Frame > Ring;
+    std::unique_ptr< SliceRenderer > Renderer;
+    Clock::time_point PlayStart;
+    Clock::time_point ClockStart;
+    long long ClockStartFrame;
+    long long NextFrame;
+    long long LastShownFrame;
+    bool Stopping;
+    std::thread Producer;
+};
+
+#endif /* CinePlayer_h */
@@ -0,0 +1,257 @@
+//
+//  CompressedBrickVolume.cpp
+//  ImageSlicing
+//
+//  Created by Tom on 23/09/2016.
+//
+//
+
+#include "CompressedBrickVolume.h"
+
+#include "WorkStealingExecutor.h"
+
+#include "itkTimeProbe.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+
+namespace
+{
+    const int BrickSize = CompressedBrickVolume::BrickSize;
+    const int BrickVoxels = BrickSize * BrickSize * BrickSize;
+
+    // Small differences either way become small unsigned numbers: 0, -1, 1, -2, 2...
+    inline std::uint32_t ZigZag( int value )
+    {
+        return ( static_cast< std::uint32_t >( value ) << 1 ) ^ static_cast< std::uint32_t >( value >> 31 );
+    }
+
+    inline int UnZigZag( std::uint32_t value )
+    {
+        return static_cast< int >( value >> 1 ) ^ -static_cast< int >( value & 1 );
+    }
+}
+
+CompressedBrickVolume::CompressedBrickVolume()
+: Geometry( vtkSmartPointer<vtkImageData>::New() ), UncompressedBytes( 0 ), NumberOfDecodes( 0 )
+{
+    this->NumberOfBricks[0] = this->NumberOfBricks[1] = this->NumberOfBricks[2] = 0;
+    this->MaximumDecodedBricks = ( std::size_t( 64 ) << 20 ) / ( BrickVoxels * sizeof( short ) );
+}
+
+void CompressedBrickVolume::EncodeBrick( const short* brick, std::vector< unsigned char >& output )
+{
+    // Each row: one byte of width, then BrickSize values of that many bits, which is exactly 2 * width bytes
+    int previousFirst = 0;
+    for ( int row = 0; row < BrickSize * BrickSize; ++row )
+    {
+        const short* values = brick + row * BrickSize;
+        std::uint32_t deltas[BrickSize];
+        deltas[0] = ZigZag( values[0] - previousFirst );
+        std::uint32_t largest = deltas[0];
+        for ( int i = 1; i < BrickSize; ++i )
+        {
+            deltas[i] = ZigZag( values[i] - values[i - 1] );
+            largest |= deltas[i];
+        }
+        previousFirst = values[0];
+
+        int width = 0;
+        while ( largest >> width )
+        {
+            ++width;
+        }
+        output.push_back( static_cast< unsigned char >( width ) );
+
+        std::uint64_t bits = 0;
+        int count = 0;
+        for ( int i = 0; i < BrickSize; ++i )
+        {
+            bits |= static_cast< std::uint64_t >( deltas[i] ) << count;
+            count += width;
+            while ( count >= 8 )
+            {
+                output.push_back( static_cast< unsigned char >( bits ) );
+                bits >>= 8;
+                count -= 8;
+            }
+        }
+    }
+}
+
+void CompressedBrickVolume::DecodeBrick( const unsigned char* input, short* brick )
+{
+    int previousFirst = 0;
+    for ( int row = 0; row < BrickSize * BrickSize; ++row )
+    {
+        short* values = brick + row * BrickSize;
+        const int width = *input++;
+        if ( width == 0 )
+        {
+            std::fill( values, values + BrickSize, static_cast< short >( previousFirst ) );
+            continue;
+        }
+
+        const std::uint32_t mask = ( 1u << width ) - 1;
+        std::uint64_t bits = 0;
+        int count = 0;
+        int value = previousFirst;
+        for ( int i = 0; i < BrickSize; ++i )
+        {
+            while ( count < width )
+            {
+                bits |= static_cast< std::uint64_t >( *input++ ) << count;
+                count += 8;
+            }
+            value += UnZigZag( static_cast< std::uint32_t >( bits ) & mask );
+            bits >>= width;
+            count -= width;
+            values[i] = static_cast< short >( value );
+        }
+        previousFirst = values[0];
+    }
+}
+
+bool CompressedBrickVolume::Compress( vtkImageData* volume )
+{
+    if ( !volume || volume->GetScalarType() != VTK_SHORT || volume->GetNumberOfScalarComponents() != 1 )
+    {
+        return false;
+    }
+
+    itk::TimeProbe clock;
+    clock.Start();
+
+    int extent[6];
+    volume->GetExtent( extent );
+    const int size[3] = { extent[1] - extent[0] + 1, extent[3] - extent[2] + 1, extent[5] - extent[4] + 1 };
+    vtkIdType increments[3];
+    volume->GetIncrements( increments );
+    const short* voxels = static_cast< const short* >( volume->GetScalarPointer( extent[0], extent[2], extent[4] ) );
+
+    int numberOfBricks[3];
+    for ( int i = 0; i < 3; ++i )
+    {
+        numberOfBricks[i] = ( size[i] + BrickSize - 1 ) / BrickSize;
+    }
+
+    // One task per layer of bricks, each compressing into its own buffers
+    std::vector< std::vector< std::vector< unsigned char > > > layers( numberOfBricks[2] );
+    std::vector< WorkStealingExecutor::TaskType > tasks;
+    for ( int bz = 0; bz < numberOfBricks[2]; ++bz )
+    {
+        tasks.push_back( [&, bz]()
+        {
+            std::vector< std::vector< unsigned char > >& layer = layers[bz];
+            layer.resize( numberOfBricks[0] * numberOfBricks[1] );
+            std::vector< short > brick( BrickVoxels );
+            for ( int by = 0; by < numberOfBricks[1]; ++by )
+            {
+                for ( int bx = 0; bx < numberOfBricks[0]; ++bx )
+                {
+                    short* out = &brick[0];
+                    for ( int k = 0; k < BrickSize; ++k )
+                    {
+                        const int z = std::min( bz * BrickSize + k, size[2] - 1 );
+                        for ( int j = 0; j < BrickSize; ++j )
+                        {
+                            const int y = std::min( by * BrickSize + j, size[1] - 1 );
+                            const short* row = voxels + y * increments[1] + z * increments[2];
+                            for ( int i = 0; i < BrickSize; ++i )
+                            {
+                                *out++ = row[std::min( bx * BrickSize + i, size[0] - 1 )];
+                            }
+                        }
+                    }
+                    EncodeBrick( &brick[0], layer[bx + by * numberOfBricks[0]] );
+                }
+            }
+        } );
+    }
+    WorkStealingExecutor executor;
+    executor.Run( tasks );
+
+    std::lock_guard< std::mutex > lock( this->Mutex );
+    this->Decoded.clear();
+    this->LruOrder.clear();
+    this->Data.clear();
+    this->Offsets.clear();
+    std::size_t totalBytes = 0;
+    for ( std::size_t bz = 0; bz < layers.size(); ++bz )
+    {
+        for ( std::size_t b = 0; b < layers[bz].size(); ++b )
+        {
+            totalBytes += layers[bz][b].size();
+        }
+    }
+    this->Data.reserve( totalBytes );
+    for ( std::size_t bz = 0; bz < layers.size(); ++bz )
+    {
+        for ( std::size_t b = 0; b < layers[bz].size(); ++b )
+        {
+            this->Offsets.push_back( this->Data.size() );
+            this->Data.insert( this->Data.end(), layers[bz][b].begin(), layers[bz][b].end() );
+        }
+    }
+    this->Offsets.push_back( this->Data.size() );
+
+    std::copy( numberOfBricks, numberOfBricks + 3, this->NumberOfBricks );
+    this->UncompressedBytes = std::size_t( size[0] ) * size[1] * size[2] * sizeof( short );
+    this->Geometry->SetExtent( extent );
+    this->Geometry->SetSpacing( volume->GetSpacing() );
+    this->Geometry->SetOrigin( volume->GetOrigin() );
+    this->Geometry->Modified();
+
+    clock.Stop();
+    std::cout << "Compressed " << ( this->UncompressedBytes >> 20 ) << " MB to " << ( this->GetCompressedBytes() >> 20 )
+              << " MB (" << static_cast< double >( this->UncompressedBytes ) / this->GetCompressedBytes() << "x) in: "
+              << clock.GetTotal() << std::endl;
+    return true;
+}
+
+void CompressedBrickVolume::SetMaximumDecodedBytes( std::size_t bytes )
+{
+    std::lock_guard< std::mutex > lock( this->Mutex );
+    this->MaximumDecodedBricks = std::max( std::size_t( 1 ), bytes / ( BrickVoxels * sizeof( short ) ) );
+    while ( this->Decoded.size() > this->MaximumDecodedBricks )
+    {
+        this->Decoded.erase( this->LruOrder.back() );
+        this->LruOrder.pop_back();
+    }
+}
+
+CompressedBrickVolume::BrickPointer CompressedBrickVolume::GetBrick( int bx, int by, int bz )
+{
+    const std::size_t index = bx + this->NumberOfBricks[0] * ( by + std::size_t( this->NumberOfBricks[1] ) * bz );
+    {
+        std::lock_guard< std::mutex > lock( this->Mutex );
+        DecodedMap::iterator found = this->Decoded.find( index );
+        if ( found != this->Decoded.end() )
+        {
+            this->LruOrder.splice( this->LruOrder.begin(), this->LruOrder, found->second.second );
+            return found->second.first;
+        }
+    }
+
+    // Decode without holding up the other threads; if two of them want the same brick at once, the second
+    // one's copy just isn't kept
+    std::shared_ptr< std::vector< short > > brick = std::make_shared< std::vector< short > >( BrickVoxels );
+    DecodeBrick( &this->Data[this->Offsets[index]], &( *brick )[0] );
+
+    std::lock_guard< std::mutex > lock( this->Mutex );
+    ++this->NumberOfDecodes;
+    DecodedMap::iterator found = this->Decoded.find( index );
+    if ( found != this->Decoded.end() )
+    {
+        return found->second.first;
+    }
+    this->LruOrder.push_front( index );
+    this->Decoded[index] = std::make_pair( BrickPointer( brick ), this->LruOrder.begin() );
+    while ( this->Decoded.size() > this->MaximumDecodedBricks )
+    {
+        this->Decoded.erase( this->LruOrder.back() );
+        this->LruOrder.pop_back();
+    }
+    return brick;
+}
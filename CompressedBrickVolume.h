@@ -0,0 +1,89 @@
+//
+//  CompressedBrickVolume.h
+//  ImageSlicing
+//
+//  Created by Tom on 23/09/2016.
+//
+//
+
+#ifndef CompressedBrickVolume_h
+#define CompressedBrickVolume_h
+
+#include "vtkSmartPointer.h"
+#include "vtkImageData.h"
+
+#include <cstddef>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/**
+ * A signed short volume kept losslessly compressed in memory, as independently compressed bricks of
+ * BrickSize^3 voxels, for series that are too big to keep resident as they are. Each brick row of BrickSize
+ * voxels is stored as the differences from the voxel before it (the first from the first voxel of the row
+ * before), zigzagged to unsigned and bit-packed at the width of the largest one. Filtered 12 bit CT mostly
+ * needs 4-7 bits a voxel, so this typically comes out at 2-3x smaller than the raw volume.
+ *
+ * Bricks are decoded when something asks for them and kept in a small least recently used cache of decoded
+ * bricks; vtkImageCompressedReslice slices straight from it. Safe to read from any number of threads.
+ */
+class CompressedBrickVolume
+{
+public:
+
+    // Voxels along each side of a brick; partial bricks at the far faces are padded by repeating the edge
+    static const int BrickSize = 16;
+
+    typedef std::shared_ptr< const std::vector< short > > BrickPointer;
+
+    CompressedBrickVolume();
+
+    // Compress a single component signed short volume (replacing anything compressed before). Returns false,
+    // and keeps nothing, for anything else.
+    bool Compress( vtkImageData* volume );
+
+    // The volume's extent, spacing and origin, with no voxels. This is the input for vtkImageCompressedReslice.
+    vtkImageData* GetGeometry() const { return this->Geometry; }
+
+    const int* GetNumberOfBricks() const { return this->NumberOfBricks; }
+
+    std::size_t GetCompressedBytes() const { return this->Data.size() + this->Offsets.size() * sizeof( std::size_t ); }
+    std::size_t GetUncompressedBytes() const { return this->UncompressedBytes; }
+
+    // Decoded bricks beyond this are dropped, least recently used first (64 MB to start with)
+    void SetMaximumDecodedBytes( std::size_t bytes );
+
+    // The decoded brick (x fastest), which stays valid while the pointer is held even if the cache drops it
+    BrickPointer GetBrick( int bx, int by, int bz );
+
+    std::size_t GetNumberOfDecodes() const { return this->NumberOfDecodes; }
+
+    // The codec on its own: a whole brick to bytes appended to output, and back
+    static void EncodeBrick( const short* brick, std::vector< unsigned char >& output );
+    static void DecodeBrick( const unsigned char* input, short* brick );
+
+private:
+
+    CompressedBrickVolume( const CompressedBrickVolume& );
+    void operator=( const CompressedBrickVolume& );
+
+    typedef std::map< std::size_t, std::pair< BrickPointer, std::list< std::size_t >::iterator > > DecodedMap;
+
+    vtkSmartPointer<vtkImageData> Geometry;
+    int NumberOfBricks[3];
+    std::size_t UncompressedBytes;
+
+    // Brick b is Data[Offsets[b], Offsets[b + 1])
+    std::vector< unsigned char > Data;
+    std::vector< std::size_t > Offsets;
+
+    std::mutex Mutex;
+    DecodedMap Decoded;
+    std::list< std::size_t > LruOrder;
+    std::size_t MaximumDecodedBricks;
+    std::size_t NumberOfDecodes;
+};
+
+#endif /* CompressedBrickVolume_h */
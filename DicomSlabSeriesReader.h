@@ -0,0 +1,97 @@
+//
+//  DicomSlabSeriesReader.h
+//  ImageSlicing
+//
+//  Created by Tom on 14/08/2016.
+//
+//
+
+#ifndef DicomSlabSeriesReader_h
+#define DicomSlabSeriesReader_h
+
+#include <itkImageSource.h>
+
+#include <string>
+#include <vector>
+
+/**
+ * Reads a sorted DICOM series (one file per Z slice, e.g. from GDCMSeriesFileNames::GetFileNames) but only
+ * opens the files that intersect the requested region of the output. Only the first and last files are
+ * looked at to work out the output information, so a downstream filter that asks for a thin slab will only
+ * cause that slab's files to be decoded.
+ */
+template< typename TImage >
+class DicomSlabSeriesReader : public itk::ImageSource< TImage >
+{
+public:
+
+    typedef DicomSlabSeriesReader Self;
+    typedef itk::ImageSource< TImage > Superclass;
+    typedef itk::SmartPointer<Self> Pointer;
+    typedef itk::SmartPointer<const Self> ConstPointer;
+
+    typedef typename TImage::PixelType PixelType;
+    typedef typename TImage::RegionType RegionType;
+    typedef std::vector< std::string > FileNamesContainer;
+
+    /** Method for creation through the object factory. */
+    itkNewMacro(Self);
+
+    /** Run-time type information (and related methods). */
+    itkTypeMacro(DicomSlabSeriesReader, itk::ImageSource);
+
+    // One file per slice, in Z order
+    void SetFileNames( const FileNamesContainer& fileNames );
+    const FileNamesContainer& GetFileNames() const { return this->m_FileNames; }
+
+    // Number of files opened by the last call to GenerateData(), so we can check that streaming works
+    itkGetConstMacro(NumberOfFilesRead, itk::SizeValueType);
+
+    // Decode the slices on GetNumberOfThreads() threads pinned with NumaTopology, each one writing (and so
+    // first-touching) its own Z slab of the output. Use with BoxCarSmoothFilter::SetUseNumaPlacement so the
+    // filter threads find their input on their own node.
+    itkSetMacro(UseNumaPlacement, bool);
+    itkGetConstMacro(UseNumaPlacement, bool);
+    itkBooleanMacro(UseNumaPlacement);
+
+    // Take the output buffer from VolumeBufferPool::GetGlobalPool() (see PooledImageContainer), so reading
+    // series after series of the same size keeps reusing one buffer
+    itkSetMacro(UseBufferPool, bool);
+    itkGetConstMacro(UseBufferPool, bool);
+    itkBooleanMacro(UseBufferPool);
+
+    // Decode a single slice file straight into a caller-supplied buffer of numberOfPixels pixels
+    static void ReadSlice( const std::string& fileName, PixelType* buffer, itk::SizeValueType numberOfPixels );
+
+    // Decode a single slice file as an image of size (x, y, 1)
+    static typename TImage::Pointer ReadSliceImage( const std::string& fileName );
+
+    void PrintSelf( std::ostream& os, itk::Indent indent ) const;
+
+protected:
+
+    DicomSlabSeriesReader() : m_NumberOfFilesRead(0), m_UseNumaPlacement(false), m_UseBufferPool(false) {};
+    virtual ~DicomSlabSeriesReader() {};
+
+    virtual void GenerateOutputInformation() ITK_OVERRIDE;
+    virtual void GenerateData() ITK_OVERRIDE;
+
+    // Read the files for slices [firstSlice, endSlice) into the matching part of the output buffer
+    void ReadSlab( itk::IndexValueType firstSlice, itk::IndexValueType endSlice );
+
+private:
+
+    DicomSlabSeriesReader(const Self &) ITK_DELETE_FUNCTION;
+    void operator=(const Self &) ITK_DELETE_FUNCTION;
+
+    FileNamesContainer m_FileNames;
+    itk::SizeValueType m_NumberOfFilesRead;
+    bool m_UseNumaPlacement;
+    bool m_UseBufferPool;
+};
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "DicomSlabSeriesReader.hxx"
+#endif
+
+#endif /* DicomSlabSeriesReader_h */
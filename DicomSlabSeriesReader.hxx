@@ -0,0 +1,213 @@
+//
+//  DicomSlabSeriesReader.hxx
+//  ImageSlicing
+//
+//  Created by Tom on 14/08/2016.
+//
+//
+
+#ifndef DicomSlabSeriesReader_hxx
+#define DicomSlabSeriesReader_hxx
+
+#include "DicomSlabSeriesReader.h"
+
+#include "itkGDCMImageIO.h"
+#include "itkImageFileReader.h"
+#include "itkTimeProbe.h"
+
+#include "NumaTopology.h"
+#include "PooledImageContainer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+template< typename TImage >
+void DicomSlabSeriesReader< TImage >::PrintSelf( std::ostream& os, itk::Indent indent ) const
+{
+    Superclass::PrintSelf( os, indent );
+    os << indent << "Number of files in series: " << this->m_FileNames.size() << std::endl;
+    os << indent << "Number of files read by last update: " << this->m_NumberOfFilesRead << std::endl;
+    os << indent << "UseNumaPlacement: " << this->m_UseNumaPlacement << std::endl;
+    os << indent << "UseBufferPool: " << this->m_UseBufferPool << std::endl;
+}
+
+template< typename TImage >
+void DicomSlabSeriesReader< TImage >::SetFileNames( const FileNamesContainer& fileNames )
+{
+    this->m_FileNames = fileNames;
+    this->Modified();
+}
+
+template< typename TImage >
+typename TImage::Pointer DicomSlabSeriesReader< TImage >::ReadSliceImage( const std::string& fileName )
+{
+    typedef itk::ImageFileReader< TImage > SliceReaderType;
+    typename SliceReaderType::Pointer sliceReader = SliceReaderType::New();
+    sliceReader->SetImageIO( itk::GDCMImageIO::New() );
+    sliceReader->SetFileName( fileName );
+    sliceReader->Update();
+
+    typename TImage::Pointer slice = sliceReader->GetOutput();
+    slice->DisconnectPipeline();
+    return slice;
+}
+
+template< typename TImage >
+void DicomSlabSeriesReader< TImage >::ReadSlice( const std::string& fileName, PixelType* buffer, itk::SizeValueType numberOfPixels )
+{
+    typename TImage::Pointer slice = ReadSliceImage( fileName );
+    if ( slice->GetBufferedRegion().GetNumberOfPixels() != numberOfPixels )
+    {
+        itkGenericExceptionMacro( << "Slice " << fileName << " has " << slice->GetBufferedRegion().GetNumberOfPixels()
+                                  << " pixels, expected " << numberOfPixels );
+    }
+    std::memcpy( buffer, slice->GetBufferPointer(), numberOfPixels * sizeof( PixelType ) );
+}
+
+template< typename TImage >
+void DicomSlabSeriesReader< TImage >::GenerateOutputInformation()
+{
+    typename TImage::Pointer output = this->GetOutput();
+
+    if ( this->m_FileNames.empty() )
+    {
+        itkExceptionMacro( << "No DICOM files have been given to the reader" );
+    }
+
+    // The in-plane geometry comes from the first file, and the slice spacing from the distance between the
+    // first and last files along the slice normal. This only needs the headers, so no pixel data is decoded.
+    itk::GDCMImageIO::Pointer firstIO = itk::GDCMImageIO::New();
+    firstIO->SetFileName( this->m_FileNames.front() );
+    firstIO->ReadImageInformation();
+
+    typename TImage::SpacingType spacing;
+    typename TImage::PointType origin;
+    typename TImage::DirectionType direction;
+    for ( unsigned int i = 0; i < 3; ++i )
+    {
+        spacing[i] = firstIO->GetSpacing( i );
+        origin[i] = firstIO->GetOrigin( i );
+        const std::vector< double > axis = firstIO->GetDirection( i );
+        for ( unsigned int j = 0; j < 3; ++j )
+        {
+            direction[j][i] = axis[j];
+        }
+    }
+
+    if ( this->m_FileNames.size() > 1 )
+    {
+        itk::GDCMImageIO::Pointer lastIO = itk::GDCMImageIO::New();
+        lastIO->SetFileName( this->m_FileNames.back() );
+        lastIO->ReadImageInformation();
+
+        double distance = 0;
+        for ( unsigned int j = 0; j < 3; ++j )
+        {
+            distance += ( lastIO->GetOrigin( j ) - origin[j] ) * direction[j][2];
+        }
+        const double sliceSpacing = std::fabs( distance ) / ( this->m_FileNames.size() - 1 );
+        if ( sliceSpacing > 0 )
+        {
+            spacing[2] = sliceSpacing;
+        }
+    }
+
+    typename TImage::SizeType size;
+    size[0] = firstIO->GetDimensions( 0 );
+    size[1] = firstIO->GetDimensions( 1 );
+    size[2] = this->m_FileNames.size();
+    typename TImage::IndexType start;
+    start.Fill( 0 );
+    RegionType largestRegion( start, size );
+
+    output->SetLargestPossibleRegion( largestRegion );
+    output->SetSpacing( spacing );
+    output->SetOrigin( origin );
+    output->SetDirection( direction );
+}
+
+template< typename TImage >
+void DicomSlabSeriesReader< TImage >::GenerateData()
+{
+    itk::TimeProbe clock;
+    clock.Start();
+
+    typename TImage::Pointer output = this->GetOutput();
+    const RegionType requestedRegion = output->GetRequestedRegion();
+    output->SetBufferedRegion( requestedRegion );
+    if ( this->m_UseBufferPool )
+    {
+        typedef PooledImageContainer< itk::SizeValueType, PixelType > PooledContainerType;
+        output->SetPixelContainer( PooledContainerType::New() );
+    }
+    output->Allocate();
+
+    const itk::IndexValueType zBegin = requestedRegion.GetIndex()[2];
+    const itk::IndexValueType zEnd = zBegin + requestedRegion.GetSize()[2];
+
+    // Only the files that intersect the requested Z range are opened
+    if ( this->m_UseNumaPlacement )
+    {
+        // BoxCarSmoothFilter::GenerateDataNumaAware splits the same range the same way
+        const unsigned int numberOfWorkers = NumaTopology::GetNumberOfSlabs( this->GetNumberOfThreads(), zEnd - zBegin );
+        NumaTopology::Get().RunPinned( numberOfWorkers, [&]( unsigned int worker )
+        {
+            long slabBegin, slabEnd;
+            NumaTopology::GetSlab( zBegin, zEnd, worker, numberOfWorkers, slabBegin, slabEnd );
+            this->ReadSlab( slabBegin, slabEnd );
+        } );
+    }
+    else
+    {
+        for ( itk::IndexValueType k = zBegin; k < zEnd; ++k )
+        {
+            this->ReadSlab( k, k + 1 );
+            this->UpdateProgress( static_cast< float >( k - zBegin + 1 ) / ( zEnd - zBegin ) );
+        }
+    }
+    this->m_NumberOfFilesRead = zEnd - zBegin;
+
+    clock.Stop();
+    std::cout << "Read " << this->m_NumberOfFilesRead << " of " << this->m_FileNames.size()
+              << " DICOM files in: " << clock.GetTotal() << std::endl;
+}
+
+template< typename TImage >
+void DicomSlabSeriesReader< TImage >::ReadSlab( itk::IndexValueType firstSlice, itk::IndexValueType endSlice )
+{
+    typename TImage::Pointer output = this->GetOutput();
+    const RegionType requestedRegion = output->GetRequestedRegion();
+    const typename TImage::IndexType start = requestedRegion.GetIndex();
+    const typename TImage::SizeType size = requestedRegion.GetSize();
+    const itk::SizeValueType rowLength = size[0];
+    const typename TImage::SizeType seriesSize = output->GetLargestPossibleRegion().GetSize();
+
+    // Each file is decoded whole (GDCM can't do any better than that) and then the requested rows are copied
+    // across into our buffer
+    for ( itk::IndexValueType k = firstSlice; k < endSlice; ++k )
+    {
+        typename TImage::Pointer slice = ReadSliceImage( this->m_FileNames[k] );
+
+        // Every file has to have the first one's matrix, or the rows below would be read from the wrong place
+        const typename TImage::SizeType sliceSize = slice->GetBufferedRegion().GetSize();
+        if ( sliceSize[0] != seriesSize[0] || sliceSize[1] != seriesSize[1] )
+        {
+            itkExceptionMacro( << "Slice " << this->m_FileNames[k] << " is " << sliceSize[0] << "x" << sliceSize[1]
+                               << ", expected " << seriesSize[0] << "x" << seriesSize[1] );
+        }
+        const PixelType* slicePixels = slice->GetBufferPointer();
+        for ( itk::IndexValueType j = start[1]; j < start[1] + static_cast< itk::IndexValueType >( size[1] ); ++j )
+        {
+            typename TImage::IndexType rowStart;
+            rowStart[0] = start[0];
+            rowStart[1] = j;
+            rowStart[2] = k;
+            std::copy( slicePixels + j * sliceSize[0] + start[0],
+                       slicePixels + j * sliceSize[0] + start[0] + rowLength,
+                       output->GetBufferPointer() + output->ComputeOffset( rowStart ) );
+        }
+    }
+}
+
+#endif /* DicomSlabSeriesReader_hxx */
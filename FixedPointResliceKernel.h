@@ -0,0 +1,167 @@
+//
+//  FixedPointResliceKernel.h
+//  ImageSlicing
+//
+//  Created by Tom on 07/09/2016.
+//
+//
+
+#ifndef FixedPointResliceKernel_h
+#define FixedPointResliceKernel_h
+
+#include <cstddef>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+// Input coordinates are 16.16 fixed point voxel indices; the interpolation weights are the top 14 bits of the
+// fraction, which keeps (b - a) * w inside 32 bits for any pair of shorts
+const int FixedPointShift = 16;
+const int FixedPointWeightBits = 14;
+
+inline int FixedPointLerp( int a, int b, int weight )
+{
+    return a + ( ( ( b - a ) * weight + ( 1 << ( FixedPointWeightBits - 1 ) ) ) >> FixedPointWeightBits );
+}
+
+/**
+ * Trilinearly interpolate count output voxels along a straight line through a signed short volume of the
+ * given size (at least 2 in every direction), starting at (x, y, z) and stepping by (dx, dy, dz), all in 16.16
+ * fixed point. Anything outside [0, size - 1] gets the background value.
+ */
+inline void FixedPointResliceRowScalar( const short* volume, const int size[3], std::ptrdiff_t rowStride, std::ptrdiff_t sliceStride,
+                                        int x, int y, int z, int dx, int dy, int dz, short background,
+                                        short* output, std::size_t count )
+{
+    const int maximum[3] = { ( size[0] - 1 ) << FixedPointShift, ( size[1] - 1 ) << FixedPointShift, ( size[2] - 1 ) << FixedPointShift };
+    const int fractionMask = ( 1 << FixedPointShift ) - 1;
+    const int weightShift = FixedPointShift - FixedPointWeightBits;
+
+    for ( std::size_t i = 0; i < count; ++i, x += dx, y += dy, z += dz )
+    {
+        if ( x < 0 || y < 0 || z < 0 || x > maximum[0] || y > maximum[1] || z > maximum[2] )
+        {
+            output[i] = background;
+            continue;
+        }
+
+        // Right on the far face, use the last cell with a weight of one so we never read past the edge
+        int ix = x >> FixedPointShift, wx = ( x & fractionMask ) >> weightShift;
+        int iy = y >> FixedPointShift, wy = ( y & fractionMask ) >> weightShift;
+        int iz = z >> FixedPointShift, wz = ( z & fractionMask ) >> weightShift;
+        if ( ix == size[0] - 1 ) { --ix; wx = 1 << FixedPointWeightBits; }
+        if ( iy == size[1] - 1 ) { --iy; wy = 1 << FixedPointWeightBits; }
+        if ( iz == size[2] - 1 ) { --iz; wz = 1 << FixedPointWeightBits; }
+
+        const short* p = volume + ix + iy * rowStride + iz * sliceStride;
+        const int c00 = FixedPointLerp( p[0], p[1], wx );
+        const int c10 = FixedPointLerp( p[rowStride], p[rowStride + 1], wx );
+        const int c01 = FixedPointLerp( p[sliceStride], p[sliceStride + 1], wx );
+        const int c11 = FixedPointLerp( p[rowStride + sliceStride], p[rowStride + sliceStride + 1], wx );
+        output[i] = static_cast< short >( FixedPointLerp( FixedPointLerp( c00, c10, wy ), FixedPointLerp( c01, c11, wy ), wz ) );
+    }
+}
+
+#if defined(__AVX2__)
+namespace FixedPointReslice
+{
+    inline __m256i Lerp( __m256i a, __m256i b, __m256i weight )
+    {
+        const __m256i half = _mm256_set1_epi32( 1 << ( FixedPointWeightBits - 1 ) );
+        return _mm256_add_epi32( a, _mm256_srai_epi32( _mm256_add_epi32( _mm256_mullo_epi32( _mm256_sub_epi32( b, a ), weight ), half ),
+                                                       FixedPointWeightBits ) );
+    }
+
+    // Each gathered 32 bit value holds the voxel and its +x neighbour
+    inline __m256i LerpPair( __m256i pair, __m256i weight )
+    {
+        const __m256i first = _mm256_srai_epi32( _mm256_slli_epi32( pair, 16 ), 16 );
+        const __m256i second = _mm256_srai_epi32( pair, 16 );
+        return Lerp( first, second, weight );
+    }
+
+    // Cell index and weight along one axis, for coordinates known to be inside
+    inline void Split( __m256i coordinate, int size, __m256i& index, __m256i& weight )
+    {
+        const __m256i last = _mm256_set1_epi32( size - 1 );
+        index = _mm256_srai_epi32( coordinate, FixedPointShift );
+        weight = _mm256_srli_epi32( _mm256_and_si256( coordinate, _mm256_set1_epi32( ( 1 << FixedPointShift ) - 1 ) ),
+                                    FixedPointShift - FixedPointWeightBits );
+        const __m256i onFarFace = _mm256_cmpeq_epi32( index, last );
+        index = _mm256_sub_epi32( index, _mm256_and_si256( onFarFace, _mm256_set1_epi32( 1 ) ) );
+        weight = _mm256_blendv_epi8( weight, _mm256_set1_epi32( 1 << FixedPointWeightBits ), onFarFace );
+    }
+
+    // All ones where 0 <= coordinate <= maximum
+    inline __m256i Inside( __m256i coordinate, int maximum )
+    {
+        return _mm256_andnot_si256( _mm256_cmpgt_epi32( _mm256_setzero_si256(), coordinate ),
+                                    _mm256_cmpgt_epi32( _mm256_set1_epi32( maximum + 1 ), coordinate ) );
+    }
+}
+#endif
+
+/**
+ * Same as FixedPointResliceRowScalar (and gives exactly the same answers), eight voxels at a time with AVX2
+ * gathers where the compiler has been told it can use them.
+ */
+inline void FixedPointResliceRow( const short* volume, const int size[3], std::ptrdiff_t rowStride, std::ptrdiff_t sliceStride,
+                                  int x, int y, int z, int dx, int dy, int dz, short background,
+                                  short* output, std::size_t count )
+{
+    std::size_t i = 0;
+#if defined(__AVX2__)
+    using namespace FixedPointReslice;
+
+    const __m256i lanes = _mm256_setr_epi32( 0, 1, 2, 3, 4, 5, 6, 7 );
+    __m256i xs = _mm256_add_epi32( _mm256_set1_epi32( x ), _mm256_mullo_epi32( lanes, _mm256_set1_epi32( dx ) ) );
+    __m256i ys = _mm256_add_epi32( _mm256_set1_epi32( y ), _mm256_mullo_epi32( lanes, _mm256_set1_epi32( dy ) ) );
+    __m256i zs = _mm256_add_epi32( _mm256_set1_epi32( z ), _mm256_mullo_epi32( lanes, _mm256_set1_epi32( dz ) ) );
+    const __m256i stepX = _mm256_set1_epi32( 8 * dx );
+    const __m256i stepY = _mm256_set1_epi32( 8 * dy );
+    const __m256i stepZ = _mm256_set1_epi32( 8 * dz );
+    const __m256i rowStrides = _mm256_set1_epi32( static_cast< int >( rowStride ) );
+    const __m256i sliceStrides = _mm256_set1_epi32( static_cast< int >( sliceStride ) );
+    const __m256i backgrounds = _mm256_set1_epi32( background );
+    const int* base = reinterpret_cast< const int* >( volume );
+
+    for ( ; i + 8 <= count; i += 8 )
+    {
+        const __m256i inside = _mm256_and_si256( Inside( xs, ( size[0] - 1 ) << FixedPointShift ),
+                               _mm256_and_si256( Inside( ys, ( size[1] - 1 ) << FixedPointShift ),
+                                                 Inside( zs, ( size[2] - 1 ) << FixedPointShift ) ) );
+        __m256i result = backgrounds;
+        if ( !_mm256_testz_si256( inside, inside ) )
+        {
+            __m256i ix, iy, iz, wx, wy, wz;
+            Split( xs, size[0], ix, wx );
+            Split( ys, size[1], iy, wy );
+            Split( zs, size[2], iz, wz );
+
+            // Lanes outside read voxel 0, and are thrown away below
+            const __m256i offset = _mm256_and_si256( inside,
+                _mm256_add_epi32( ix, _mm256_add_epi32( _mm256_mullo_epi32( iy, rowStrides ), _mm256_mullo_epi32( iz, sliceStrides ) ) ) );
+            const __m256i c00 = LerpPair( _mm256_i32gather_epi32( base, offset, 2 ), wx );
+            const __m256i c10 = LerpPair( _mm256_i32gather_epi32( base, _mm256_add_epi32( offset, rowStrides ), 2 ), wx );
+            const __m256i c01 = LerpPair( _mm256_i32gather_epi32( base, _mm256_add_epi32( offset, sliceStrides ), 2 ), wx );
+            const __m256i c11 = LerpPair( _mm256_i32gather_epi32( base, _mm256_add_epi32( offset, _mm256_add_epi32( rowStrides, sliceStrides ) ), 2 ), wx );
+            const __m256i value = Lerp( Lerp( c00, c10, wy ), Lerp( c01, c11, wy ), wz );
+            result = _mm256_blendv_epi8( backgrounds, value, inside );
+        }
+
+        // Pack the eight 32 bit results down to shorts (packs works within each 128 bit half)
+        const __m256i packed = _mm256_permute4x64_epi64( _mm256_packs_epi32( result, result ), 0x08 );
+        _mm_storeu_si128( reinterpret_cast< __m128i* >( output + i ), _mm256_castsi256_si128( packed ) );
+
+        xs = _mm256_add_epi32( xs, stepX );
+        ys = _mm256_add_epi32( ys, stepY );
+        zs = _mm256_add_epi32( zs, stepZ );
+    }
+#endif
+    FixedPointResliceRowScalar( volume, size, rowStride, sliceStride,
+                                x + static_cast< int >( i ) * dx, y + static_cast< int >( i ) * dy, z + static_cast< int >( i ) * dz,
+                                dx, dy, dz, background, output + i, count - i );
+}
+
+#endif /* FixedPointResliceKernel_h */
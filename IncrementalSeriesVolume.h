@@ -0,0 +1,84 @@
+//
+//  IncrementalSeriesVolume.h
+//  ImageSlicing
+//
+//  Created by Tom on 02/09/2016.
+//
+//
+
+#ifndef IncrementalSeriesVolume_h
+#define IncrementalSeriesVolume_h
+
+#include "vtkSmartPointer.h"
+#include "vtkImageData.h"
+
+#include <set>
+#include <string>
+#include <vector>
+
+/**
+ * A box-car filtered volume that can have slices added to it as they arrive (see SeriesDirectoryWatcher), for
+ * looking at a study while it is still being acquired. The decoded slices are kept, so adding files only costs
+ * decoding those files and re-filtering the slices whose 3x3x3 neighbourhood changed (the new slices and the
+ * ones either side of them). The decoded slices are kept one buffer each, so slotting one in is cheap; the
+ * filtered volume is a single buffer for VTK, and only the part after the first new slice is moved along, once
+ * per AddFiles().
+ *
+ * Files are slotted in by their position along the slice normal, as GDCMSeriesFileNames would have sorted them.
+ * Edges are handled by clamping, like the in-place filter, so the output covers the whole series.
+ */
+template< typename TImage >
+class IncrementalSeriesVolume
+{
+public:
+
+    typedef typename TImage::PixelType PixelType;
+    typedef std::vector< std::string > FileNamesContainer;
+
+    IncrementalSeriesVolume();
+
+    // Files from other series are ignored. With no identifier, the first file decides.
+    void SetSeriesIdentifier( const std::string& seriesIdentifier ) { this->SeriesIdentifier = seriesIdentifier; }
+
+    // Decode whichever of the files are new and belong to the series, put them in order and re-filter the slices
+    // they affect. Files that fail to read are reported and skipped, and are read again if passed in again.
+    // Returns the number of slices added.
+    unsigned int AddFiles( const FileNamesContainer& fileNames );
+
+    unsigned int GetNumberOfSlices() const { return static_cast< unsigned int >( this->Positions.size() ); }
+
+    // The same object for the life of this one; AddFiles updates it in place (and calls Modified)
+    vtkImageData* GetOutput() const { return this->Output; }
+
+private:
+
+    // Filter slice k of RawSlices into slice k of Filtered
+    void FilterSlice( std::size_t k );
+
+    // Point the output at Filtered, with the current extent, spacing and origin. The slice spacing is the
+    // median gap between neighbouring slices, which is right while slices are still missing here and there.
+    void UpdateOutput();
+
+    std::string SeriesIdentifier;
+    std::set< std::string > KnownFiles;
+
+    std::size_t Width;
+    std::size_t Height;
+    double Normal[3];
+    double FirstOrigin[3];
+    double FirstPosition;
+    double PixelSpacing[2];
+
+    // One entry per slice, in increasing position along the normal
+    std::vector< double > Positions;
+    std::vector< std::vector< PixelType > > RawSlices;
+    
+    // All the filtered slices, one after the other
+    std::vector< PixelType > Filtered;
+
+    vtkSmartPointer<vtkImageData> Output;
+};
+
+#include "IncrementalSeriesVolume.hxx"
+
+#endif /* IncrementalSeriesVolume_h */
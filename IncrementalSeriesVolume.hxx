@@ -0,0 +1,226 @@
+//
+//  IncrementalSeriesVolume.hxx
+//  ImageSlicing
+//
+//  Created by Tom on 02/09/2016.
+//
+//
+
+#ifndef IncrementalSeriesVolume_hxx
+#define IncrementalSeriesVolume_hxx
+
+#include "IncrementalSeriesVolume.h"
+
+#include "BoxCarKernel.h"
+#include "DicomSlabSeriesReader.h"
+
+#include "itkGDCMImageIO.h"
+#include "itkTimeProbe.h"
+#include "vtkDataArray.h"
+#include "vtkPointData.h"
+#include "vtkTypeTraits.h"
+
+#include <algorithm>
+#include <iostream>
+#include <utility>
+
+template< typename TImage >
+IncrementalSeriesVolume< TImage >::IncrementalSeriesVolume()
+: Width( 0 ), Height( 0 ), FirstPosition( 0 ), Output( vtkSmartPointer<vtkImageData>::New() )
+{
+    for ( int i = 0; i < 3; ++i )
+    {
+        this->Normal[i] = ( i == 2 ) ? 1.0 : 0.0;
+        this->FirstOrigin[i] = 0.0;
+    }
+    this->PixelSpacing[0] = this->PixelSpacing[1] = 1.0;
+}
+
+template< typename TImage >
+unsigned int IncrementalSeriesVolume< TImage >::AddFiles( const FileNamesContainer& fileNames )
+{
+    itk::TimeProbe clock;
+    clock.Start();
+
+    // Read the headers and decode the new slices
+    std::vector< std::pair< double, std::vector< PixelType > > > arrivals;
+    for ( std::size_t f = 0; f < fileNames.size(); ++f )
+    {
+        const std::string& fileName = fileNames[f];
+        // Files are only remembered once they have been dealt with, so one that fails to read (say because it
+        // was still being written) is tried again if it is passed in again
+        if ( this->KnownFiles.count( fileName ) )
+        {
+            continue;
+        }
+        try
+        {
+            itk::GDCMImageIO::Pointer io = itk::GDCMImageIO::New();
+            io->SetFileName( fileName );
+            io->ReadImageInformation();
+
+            std::string seriesUID;
+            io->GetValueFromTag( "0020|000e", seriesUID );
+            seriesUID.erase( seriesUID.find_last_not_of( std::string( " \0", 2 ) ) + 1 );
+            if ( this->SeriesIdentifier.empty() )
+            {
+                this->SeriesIdentifier = seriesUID;
+            }
+            // GDCMSeriesFileNames identifiers can have extra details tacked on the end of the UID
+            if ( seriesUID.empty() || this->SeriesIdentifier.compare( 0, seriesUID.size(), seriesUID ) != 0 )
+            {
+                this->KnownFiles.insert( fileName );
+                continue;
+            }
+
+            if ( this->Positions.empty() && arrivals.empty() )
+            {
+                this->Width = io->GetDimensions( 0 );
+                this->Height = io->GetDimensions( 1 );
+                this->PixelSpacing[0] = io->GetSpacing( 0 );
+                this->PixelSpacing[1] = io->GetSpacing( 1 );
+                const std::vector< double > normal = io->GetDirection( 2 );
+                for ( int i = 0; i < 3; ++i )
+                {
+                    this->Normal[i] = normal[i];
+                    this->FirstOrigin[i] = io->GetOrigin( i );
+                }
+                this->FirstPosition = this->FirstOrigin[0] * this->Normal[0] + this->FirstOrigin[1] * this->Normal[1]
+                                    + this->FirstOrigin[2] * this->Normal[2];
+            }
+            else if ( io->GetDimensions( 0 ) != this->Width || io->GetDimensions( 1 ) != this->Height )
+            {
+                std::cerr << "Skipping " << fileName << ": slice size doesn't match the series" << std::endl;
+                this->KnownFiles.insert( fileName );
+                continue;
+            }
+
+            double position = 0;
+            for ( int i = 0; i < 3; ++i )
+            {
+                position += io->GetOrigin( i ) * this->Normal[i];
+            }
+
+            std::vector< PixelType > pixels( this->Width * this->Height );
+            DicomSlabSeriesReader< TImage >::ReadSlice( fileName, &pixels[0], pixels.size() );
+            this->KnownFiles.insert( fileName );
+            arrivals.push_back( std::make_pair( position, std::vector< PixelType >() ) );
+            arrivals.back().second.swap( pixels );
+        }
+        catch ( itk::ExceptionObject& ex )
+        {
+            std::cerr << "Skipping " << fileName << ": " << ex.GetDescription() << std::endl;
+        }
+    }
+
+    // Slot them in (which only moves the slices' buffers, not their pixels), remembering where each slice was
+    // before, or -1 for the new ones
+    const std::size_t sliceSize = this->Width * this->Height;
+    std::vector< long > previous( this->Positions.size() );
+    for ( std::size_t k = 0; k < previous.size(); ++k )
+    {
+        previous[k] = static_cast< long >( k );
+    }
+    unsigned int added = 0;
+    for ( std::size_t a = 0; a < arrivals.size(); ++a )
+    {
+        const std::vector< double >::iterator at = std::lower_bound( this->Positions.begin(), this->Positions.end(), arrivals[a].first );
+        if ( at != this->Positions.end() && *at == arrivals[a].first )
+        {
+            // Same position as a slice we already have (re-sent, or a different file name for the same file)
+            continue;
+        }
+        const std::size_t k = at - this->Positions.begin();
+        this->Positions.insert( at, arrivals[a].first );
+        previous.insert( previous.begin() + k, -1 );
+        this->RawSlices.insert( this->RawSlices.begin() + k, std::vector< PixelType >() );
+        this->RawSlices[k].swap( arrivals[a].second );
+        ++added;
+    }
+    if ( added == 0 )
+    {
+        return 0;
+    }
+
+    // Move the filtered slices that stay up to their new places in one go. Slices only ever move up, so working
+    // down from the top never overwrites one that hasn't been moved yet. Anything appended at the end leaves
+    // the rest where it was.
+    const std::size_t numberOfSlices = this->Positions.size();
+    this->Filtered.resize( numberOfSlices * sliceSize );
+    for ( std::size_t k = numberOfSlices; k-- > 0; )
+    {
+        if ( previous[k] >= 0 && static_cast< std::size_t >( previous[k] ) != k )
+        {
+            std::copy( this->Filtered.begin() + previous[k] * sliceSize, this->Filtered.begin() + ( previous[k] + 1 ) * sliceSize,
+                       this->Filtered.begin() + k * sliceSize );
+        }
+    }
+
+    // New slices and their neighbours either side
+    std::size_t refiltered = 0;
+    for ( std::size_t k = 0; k < numberOfSlices; ++k )
+    {
+        if ( previous[k] < 0 || ( k > 0 && previous[k - 1] < 0 ) || ( k + 1 < numberOfSlices && previous[k + 1] < 0 ) )
+        {
+            this->FilterSlice( k );
+            ++refiltered;
+        }
+    }
+
+    this->UpdateOutput();
+
+    clock.Stop();
+    std::cout << "Added " << added << " slices (re-filtered " << refiltered << " of " << numberOfSlices
+              << ") in: " << clock.GetTotal() << std::endl;
+    return added;
+}
+
+template< typename TImage >
+void IncrementalSeriesVolume< TImage >::FilterSlice( std::size_t k )
+{
+    const std::size_t sliceSize = this->Width * this->Height;
+    const std::size_t last = this->Positions.size() - 1;
+    const PixelType* below = &this->RawSlices[k > 0 ? k - 1 : 0][0];
+    const PixelType* centre = &this->RawSlices[k][0];
+    const PixelType* above = &this->RawSlices[k < last ? k + 1 : last][0];
+    PixelType* output = &this->Filtered[k * sliceSize];
+    for ( std::size_t j = 0; j < this->Height; ++j )
+    {
+        BoxCarSmoothClampedRow( below, centre, above, this->Width, this->Height, j, output + j * this->Width );
+    }
+}
+
+template< typename TImage >
+void IncrementalSeriesVolume< TImage >::UpdateOutput()
+{
+    const std::size_t numberOfSlices = this->Positions.size();
+    double sliceSpacing = 1.0;
+    if ( numberOfSlices > 1 )
+    {
+        // Not (last - first) / (n - 1), which comes out too big while there are gaps still to be filled in
+        std::vector< double > gaps( numberOfSlices - 1 );
+        for ( std::size_t k = 0; k + 1 < numberOfSlices; ++k )
+        {
+            gaps[k] = this->Positions[k + 1] - this->Positions[k];
+        }
+        std::nth_element( gaps.begin(), gaps.begin() + gaps.size() / 2, gaps.end() );
+        sliceSpacing = gaps[gaps.size() / 2];
+    }
+    const double shift = this->Positions.front() - this->FirstPosition;
+
+    this->Output->SetExtent( 0, static_cast< int >( this->Width ) - 1, 0, static_cast< int >( this->Height ) - 1,
+                             0, static_cast< int >( numberOfSlices ) - 1 );
+    this->Output->SetSpacing( this->PixelSpacing[0], this->PixelSpacing[1], sliceSpacing );
+    this->Output->SetOrigin( this->FirstOrigin[0] + shift * this->Normal[0], this->FirstOrigin[1] + shift * this->Normal[1],
+                             this->FirstOrigin[2] + shift * this->Normal[2] );
+
+    // Filtered may have moved when it grew, so always hand VTK the current pointer (which it mustn't free)
+    vtkSmartPointer<vtkDataArray> scalars;
+    scalars.TakeReference( vtkDataArray::CreateDataArray( vtkTypeTraits< PixelType >::VTKTypeID() ) );
+    scalars->SetNumberOfComponents( 1 );
+    scalars->SetVoidArray( &this->Filtered[0], static_cast< vtkIdType >( this->Filtered.size() ), 1 );
+    this->Output->GetPointData()->SetScalars( scalars );
+    this->Output->Modified();
+}
+
+#endif /* IncrementalSeriesVolume_hxx */
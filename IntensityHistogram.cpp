@@ -0,0 +1,121 @@
+//
+//  IntensityHistogram.cpp
+//  ImageSlicing
+//
+//  Created by Tom on 14/09/2016.
+//
+//
+
+#include "IntensityHistogram.h"
+
+#include <cmath>
+
+IntensityHistogram::IntensityHistogram()
+: Bins( 65536, 0 )
+{
+    this->Clear();
+}
+
+void IntensityHistogram::Clear()
+{
+    std::fill( this->Bins.begin(), this->Bins.end(), 0 );
+    this->Minimum = 32767;
+    this->Maximum = -32768;
+}
+
+void IntensityHistogram::Merge( const IntensityHistogram& other )
+{
+    if ( other.IsEmpty() )
+    {
+        return;
+    }
+    for ( int value = other.Minimum; value <= other.Maximum; ++value )
+    {
+        this->Bins[value + 32768] += other.Bins[value + 32768];
+    }
+    this->Minimum = std::min( this->Minimum, other.Minimum );
+    this->Maximum = std::max( this->Maximum, other.Maximum );
+}
+
+std::size_t IntensityHistogram::GetNumberOfVoxels() const
+{
+    std::size_t total = 0;
+    for ( int value = this->Minimum; value <= this->Maximum; ++value )
+    {
+        total += this->Bins[value + 32768];
+    }
+    return total;
+}
+
+int IntensityHistogram::GetPercentile( double fraction, bool excludeMinimum ) const
+{
+    if ( this->IsEmpty() )
+    {
+        return 0;
+    }
+
+    // Unless that would leave nothing at all
+    int first = this->Minimum;
+    std::size_t total = this->GetNumberOfVoxels();
+    if ( excludeMinimum && this->Maximum > this->Minimum )
+    {
+        total -= this->Bins[first + 32768];
+        ++first;
+    }
+
+    const double target = std::min( std::max( fraction, 0.0 ), 1.0 ) * total;
+    std::size_t below = 0;
+    for ( int value = first; value < this->Maximum; ++value )
+    {
+        below += this->Bins[value + 32768];
+        if ( below >= target && below > 0 )
+        {
+            return value;
+        }
+    }
+    return this->Maximum;
+}
+
+std::vector< IntensityHistogram::WindowLevelPreset > IntensityHistogram::GetWindowLevelPresets() const
+{
+    struct Range { const char* Name; double Low; double High; };
+    static const Range ranges[] = {
+        { "Auto (1-99%)", 0.01, 0.99 },
+        { "Wide (0.1-99.9%)", 0.001, 0.999 },
+        { "Contrast (5-95%)", 0.05, 0.95 } };
+
+    std::vector< WindowLevelPreset > presets;
+    for ( const Range& range : ranges )
+    {
+        const int low = this->GetPercentile( range.Low, true );
+        const int high = this->GetPercentile( range.High, true );
+        WindowLevelPreset preset = { range.Name, std::max( 1.0, static_cast< double >( high - low ) ), 0.5 * ( low + high ) };
+        presets.push_back( preset );
+    }
+
+    WindowLevelPreset full = { "Full range", std::max( 1.0, static_cast< double >( this->Maximum - this->Minimum ) ),
+                               0.5 * ( this->Minimum + this->Maximum ) };
+    presets.push_back( full );
+    return presets;
+}
+
+IntensityHistogram& ThreadLocalHistograms::Local()
+{
+    std::lock_guard< std::mutex > lock( this->Mutex );
+    std::unique_ptr< IntensityHistogram >& histogram = this->Histograms[std::this_thread::get_id()];
+    if ( !histogram )
+    {
+        histogram.reset( new IntensityHistogram );
+    }
+    return *histogram;
+}
+
+void ThreadLocalHistograms::MergeInto( IntensityHistogram& total )
+{
+    std::lock_guard< std::mutex > lock( this->Mutex );
+    for ( auto& histogram : this->Histograms )
+    {
+        total.Merge( *histogram.second );
+    }
+    this->Histograms.clear();
+}
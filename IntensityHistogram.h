@@ -0,0 +1,110 @@
+//
+//  IntensityHistogram.h
+//  ImageSlicing
+//
+//  Created by Tom on 14/09/2016.
+//
+//
+
+#ifndef IntensityHistogram_h
+#define IntensityHistogram_h
+
+#include <algorithm>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Histogram with one bin per signed 16 bit value (anything else is rounded towards zero and clamped into
+ * that range), plus the minimum and maximum. It is meant to be filled a row at a time by whatever writes the
+ * voxels, while the row is still in cache, so that the display range comes for free instead of costing
+ * another pass over the volume.
+ */
+class IntensityHistogram
+{
+public:
+
+    struct WindowLevelPreset
+    {
+        const char* Name;
+        double Window;
+        double Level;
+    };
+
+    IntensityHistogram();
+
+    void Clear();
+
+    void Add( int value, std::size_t count = 1 )
+    {
+        value = std::min( std::max( value, -32768 ), 32767 );
+        this->Bins[value + 32768] += count;
+        this->Minimum = std::min( this->Minimum, value );
+        this->Maximum = std::max( this->Maximum, value );
+    }
+
+    template< typename TPixel >
+    void AddRow( const TPixel* row, std::size_t count )
+    {
+        if ( count == 0 )
+        {
+            return;
+        }
+        int minimum = this->Minimum, maximum = this->Maximum;
+        for ( std::size_t i = 0; i < count; ++i )
+        {
+            const int value = std::min( std::max( static_cast< int >( row[i] ), -32768 ), 32767 );
+            ++this->Bins[value + 32768];
+            minimum = std::min( minimum, value );
+            maximum = std::max( maximum, value );
+        }
+        this->Minimum = minimum;
+        this->Maximum = maximum;
+    }
+
+    void Merge( const IntensityHistogram& other );
+
+    std::size_t GetNumberOfVoxels() const;
+    bool IsEmpty() const { return this->Minimum > this->Maximum; }
+    int GetMinimum() const { return this->Minimum; }
+    int GetMaximum() const { return this->Maximum; }
+
+    // The value below which the given fraction of the voxels lie. With excludeMinimum, voxels at the very
+    // lowest value (padding, or air outside the scanner's field of view) aren't counted.
+    int GetPercentile( double fraction, bool excludeMinimum = false ) const;
+
+    // Windows between pairs of percentiles of the voxels above the minimum, starting with the 1-99% one
+    // that makes a sensible default, and ending with the full range
+    std::vector< WindowLevelPreset > GetWindowLevelPresets() const;
+
+private:
+
+    std::vector< std::size_t > Bins;
+    int Minimum;
+    int Maximum;
+};
+
+/**
+ * One IntensityHistogram per thread that asks for one, to be merged once they've all finished. For filling
+ * from pools where the worker doing a task isn't known in advance; Local() is cheap enough to call once per
+ * task, but not once per row.
+ */
+class ThreadLocalHistograms
+{
+public:
+
+    IntensityHistogram& Local();
+
+    // Add all of them into total, and forget them
+    void MergeInto( IntensityHistogram& total );
+
+private:
+
+    std::mutex Mutex;
+    std::map< std::thread::id, std::unique_ptr< IntensityHistogram > > Histograms;
+};
+
+#endif /* IntensityHistogram_h */
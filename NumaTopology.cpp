@@ -0,0 +1,281 @@
+//
+//  NumaTopology.cpp
+//  ImageSlicing
+//
+//  Created by Tom on 23/08/2016.
+//
+//
+
+#include "NumaTopology.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace
+{
+    // Parse a kernel cpu list such as "0-7,16-23"
+    std::vector< int > ParseCpuList( const std::string& text )
+    {
+        std::vector< int > cpus;
+        std::stringstream stream( text );
+        std::string range;
+        while ( std::getline( stream, range, ',' ) )
+        {
+            if ( range.empty() || range[0] == '\n' )
+            {
+                continue;
+            }
+            const std::string::size_type dash = range.find( '-' );
+            const int first = std::atoi( range.substr( 0, dash ).c_str() );
+            const int last = ( dash == std::string::npos ) ? first : std::atoi( range.substr( dash + 1 ).c_str() );
+            for ( int cpu = first; cpu <= last; ++cpu )
+            {
+                cpus.push_back( cpu );
+            }
+        }
+        return cpus;
+    }
+}
+
+// Threads pinned once for a given number of workers, which then wait for each run's function
+struct NumaTopology::WorkerPool
+{
+    WorkerPool( const NumaTopology& topology, unsigned int numberOfWorkers )
+    : Function( nullptr ), Generation( 0 ), Remaining( 0 ), Stopping( false )
+    {
+        const bool pin = topology.IsMultiNode();
+        for ( unsigned int worker = 0; worker < numberOfWorkers; ++worker )
+        {
+            const int cpu = topology.GetCpuForWorker( worker, numberOfWorkers );
+            this->Threads.push_back( std::thread( [this, worker, cpu, pin]()
+            {
+                if ( pin )
+                {
+                    PinCurrentThread( cpu );
+                }
+                this->WorkerLoop( worker );
+            } ) );
+        }
+    }
+
+    ~WorkerPool()
+    {
+        {
+            std::lock_guard< std::mutex > lock( this->Mutex );
+            this->Stopping = true;
+        }
+        this->WorkAvailable.notify_all();
+        for ( std::size_t t = 0; t < this->Threads.size(); ++t )
+        {
+            this->Threads[t].join();
+        }
+    }
+
+    void Run( const std::function< void( unsigned int ) >& function )
+    {
+        std::unique_lock< std::mutex > lock( this->Mutex );
+        this->Function = &function;
+        this->Failure = std::exception_ptr();
+        this->Remaining = static_cast< unsigned int >( this->Threads.size() );
+        ++this->Generation;
+        this->WorkAvailable.notify_all();
+        this->WorkFinished.wait( lock, [this]() { return this->Remaining == 0; } );
+        this->Function = nullptr;
+        if ( this->Failure )
+        {
+            std::rethrow_exception( this->Failure );
+        }
+    }
+
+    void WorkerLoop( unsigned int worker )
+    {
+        unsigned long done = 0;
+        std::unique_lock< std::mutex > lock( this->Mutex );
+        for ( ;; )
+        {
+            this->WorkAvailable.wait( lock, [&]() { return this->Stopping || this->Generation != done; } );
+            if ( this->Stopping )
+            {
+                return;
+            }
+            done = this->Generation;
+            const std::function< void( unsigned int ) >& function = *this->Function;
+
+            lock.unlock();
+            std::exception_ptr failure;
+            try
+            {
+                function( worker );
+            }
+            catch ( ... )
+            {
+                failure = std::current_exception();
+            }
+            lock.lock();
+
+            if ( failure && !this->Failure )
+            {
+                this->Failure = failure;
+            }
+            if ( --this->Remaining == 0 )
+            {
+                this->WorkFinished.notify_all();
+            }
+        }
+    }
+
+    std::mutex Mutex;
+    std::condition_variable WorkAvailable;
+    std::condition_variable WorkFinished;
+    std::vector< std::thread > Threads;
+    const std::function< void( unsigned int ) >* Function;
+    unsigned long Generation;
+    unsigned int Remaining;
+    std::exception_ptr Failure;
+    bool Stopping;
+};
+
+const NumaTopology& NumaTopology::Get()
+{
+    static NumaTopology topology;
+    return topology;
+}
+
+NumaTopology::NumaTopology()
+{
+#if defined(__linux__)
+    for ( unsigned int node = 0; ; ++node )
+    {
+        std::ostringstream path;
+        path << "/sys/devices/system/node/node" << node << "/cpulist";
+        std::ifstream file( path.str().c_str() );
+        if ( !file )
+        {
+            break;
+        }
+        std::string text;
+        std::getline( file, text );
+        const std::vector< int > cpus = ParseCpuList( text );
+        if ( !cpus.empty() )
+        {
+            this->NodeCpus.push_back( cpus );
+        }
+    }
+#endif
+
+    // Fall back to one node with every core on it
+    if ( this->NodeCpus.empty() )
+    {
+        const int cores = static_cast< int >( std::max( 1u, std::thread::hardware_concurrency() ) );
+        std::vector< int > cpus;
+        for ( int cpu = 0; cpu < cores; ++cpu )
+        {
+            cpus.push_back( cpu );
+        }
+        this->NodeCpus.push_back( cpus );
+    }
+}
+
+NumaTopology::~NumaTopology()
+{
+}
+
+unsigned int NumaTopology::GetNodeForWorker( unsigned int worker, unsigned int numberOfWorkers ) const
+{
+    return static_cast< unsigned int >( static_cast< unsigned long >( worker ) * this->NodeCpus.size() / numberOfWorkers );
+}
+
+int NumaTopology::GetCpuForWorker( unsigned int worker, unsigned int numberOfWorkers ) const
+{
+    // Workers are shared out evenly between the nodes, in order, then round-robin over each node's cores
+    const unsigned int node = this->GetNodeForWorker( worker, numberOfWorkers );
+    unsigned int firstOnNode = 0;
+    while ( this->GetNodeForWorker( firstOnNode, numberOfWorkers ) != node )
+    {
+        ++firstOnNode;
+    }
+    const std::vector< int >& cpus = this->NodeCpus[node];
+    return cpus[( worker - firstOnNode ) % cpus.size()];
+}
+
+void NumaTopology::GetSlab( long begin, long end, unsigned int worker, unsigned int numberOfWorkers, long& slabBegin, long& slabEnd )
+{
+    const long length = end - begin;
+    slabBegin = begin + length * worker / numberOfWorkers;
+    slabEnd = begin + length * ( worker + 1 ) / numberOfWorkers;
+}
+
+void NumaTopology::GetSlab( long begin, long end, long clipBegin, long clipEnd, unsigned int worker, unsigned int numberOfWorkers,
+                            long& slabBegin, long& slabEnd )
+{
+    GetSlab( begin, end, worker, numberOfWorkers, slabBegin, slabEnd );
+    slabBegin = std::max( slabBegin, clipBegin );
+    slabEnd = std::max( slabBegin, std::min( slabEnd, clipEnd ) );
+}
+
+unsigned int NumaTopology::GetNumberOfSlabs( unsigned int numberOfThreads, long length )
+{
+    return static_cast< unsigned int >( std::max< long >( 1, std::min< long >( numberOfThreads, length ) ) );
+}
+
+bool NumaTopology::PinCurrentThread( int cpu )
+{
+#if defined(__linux__)
+    if ( cpu < 0 || cpu >= CPU_SETSIZE )
+    {
+        return false;
+    }
+    cpu_set_t set;
+    CPU_ZERO( &set );
+    CPU_SET( cpu, &set );
+    return pthread_setaffinity_np( pthread_self(), sizeof( set ), &set ) == 0;
+#else
+    (void)cpu;
+    return false;
+#endif
+}
+
+void NumaTopology::RunPinned( unsigned int numberOfWorkers, const std::function< void( unsigned int ) >& function ) const
+{
+    // Take the pool while we use it, so that a run on another thread at the same time makes its own
+    std::unique_ptr< WorkerPool > pool;
+    {
+        std::lock_guard< std::mutex > lock( this->PoolMutex );
+        pool = std::move( this->Pool );
+    }
+    if ( !pool || pool->Threads.size() != numberOfWorkers )
+    {
+        pool.reset( new WorkerPool( *this, numberOfWorkers ) );
+    }
+
+    std::exception_ptr failure;
+    try
+    {
+        pool->Run( function );
+    }
+    catch ( ... )
+    {
+        failure = std::current_exception();
+    }
+
+    {
+        std::lock_guard< std::mutex > lock( this->PoolMutex );
+        this->Pool = std::move( pool );
+    }
+    if ( failure )
+    {
+        std::rethrow_exception( failure );
+    }
+}
@@ -0,0 +1,79 @@
+//
+//  NumaTopology.h
+//  ImageSlicing
+//
+//  Created by Tom on 23/08/2016.
+//
+//
+
+#ifndef NumaTopology_h
+#define NumaTopology_h
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/**
+ * Which cores belong to which memory node, so that we can keep each thread working on memory that lives on
+ * its own socket. On Linux this comes from /sys/devices/system/node; anywhere else (or if that can't be read)
+ * we just get one node containing every core, and nothing is pinned.
+ *
+ * The idea is that a volume is split into Z slabs, one per worker, with consecutive workers on the same node.
+ * If the same workers first-touch (allocate) and then process the same slabs, each slab's pages end up on
+ * the node that reads and writes them. The reader and the filter both split the reader's (halo padded) Z range
+ * with GetNumberOfSlabs / GetSlab, so that their slab boundaries are the same slices.
+ */
+class NumaTopology
+{
+public:
+
+    // Detected once, on first use
+    static const NumaTopology& Get();
+
+    unsigned int GetNumberOfNodes() const { return static_cast< unsigned int >( this->NodeCpus.size() ); }
+    const std::vector< int >& GetCpus( unsigned int node ) const { return this->NodeCpus[node]; }
+    bool IsMultiNode() const { return this->NodeCpus.size() > 1; }
+
+    // The node and core that worker should run on, out of a team of numberOfWorkers
+    unsigned int GetNodeForWorker( unsigned int worker, unsigned int numberOfWorkers ) const;
+    int GetCpuForWorker( unsigned int worker, unsigned int numberOfWorkers ) const;
+
+    ~NumaTopology();
+
+    // Run function( worker ) on numberOfWorkers threads and wait for them all. On a multi-node machine each
+    // thread is pinned to the core from GetCpuForWorker. The threads are kept (and stay pinned) for the next
+    // run with the same number of workers; if another run is already using them, this one gets its own. The
+    // first exception thrown is rethrown here.
+    void RunPinned( unsigned int numberOfWorkers, const std::function< void( unsigned int ) >& function ) const;
+
+    // How many slabs length slices are split into, given numberOfThreads
+    static unsigned int GetNumberOfSlabs( unsigned int numberOfThreads, long length );
+
+    // The part [slabBegin, slabEnd) of [begin, end) that worker owns
+    static void GetSlab( long begin, long end, unsigned int worker, unsigned int numberOfWorkers, long& slabBegin, long& slabEnd );
+
+    // The same slab, clipped to [clipBegin, clipEnd): for a filter writing a range a halo narrower than the
+    // [begin, end) its input was split over, so that each worker writes what it read
+    static void GetSlab( long begin, long end, long clipBegin, long clipEnd, unsigned int worker, unsigned int numberOfWorkers,
+                         long& slabBegin, long& slabEnd );
+
+    // Returns false if pinning isn't supported here, or the core doesn't exist
+    static bool PinCurrentThread( int cpu );
+
+private:
+
+    NumaTopology();
+    NumaTopology( const NumaTopology& );
+    void operator=( const NumaTopology& );
+
+    struct WorkerPool;
+
+    std::vector< std::vector< int > > NodeCpus;
+
+    // The pinned threads from the last run, and whether a run is using them
+    mutable std::mutex PoolMutex;
+    mutable std::unique_ptr< WorkerPool > Pool;
+};
+
+#endif /* NumaTopology_h */
@@ -0,0 +1,63 @@
+//
+//  PipelinedSeriesLoader.h
+//  ImageSlicing
+//
+//  Created by Tom on 16/08/2016.
+//
+//
+
+#ifndef PipelinedSeriesLoader_h
+#define PipelinedSeriesLoader_h
+
+#include "vtkSmartPointer.h"
+#include "vtkImageData.h"
+
+#include "IntensityHistogram.h"
+
+#include <string>
+#include <vector>
+
+/**
+ * Does the same job as the reader -> BoxCarSmoothFilter -> crop -> ITK-to-VTK chain in TgwSlicer, but with
+ * the stages overlapped rather than run one after the other. Decoder threads read slices in Z order, and as
+ * soon as slices z-1, z and z+1 are in memory a filter thread smooths slice z straight into the VTK image.
+ * The total time ends up close to whichever stage is slowest (usually the DICOM decode) on its own.
+ *
+ * Like the ITK pipeline (which filters one voxel in from every face and then crops two), the output only
+ * covers the region two voxels in from every face, and keeps the ITK index as its extent, so both give the
+ * same geometry for the same series.
+ */
+template< typename TImage >
+class PipelinedSeriesLoader
+{
+public:
+
+    typedef typename TImage::PixelType PixelType;
+    typedef std::vector< std::string > FileNamesContainer;
+
+    PipelinedSeriesLoader();
+
+    // One file per slice, in Z order
+    void SetFileNames( const FileNamesContainer& fileNames ) { this->FileNames = fileNames; }
+
+    // Defaults to a quarter of the cores for decoding and the rest for filtering
+    void SetNumberOfDecodeThreads( unsigned int threads ) { this->NumberOfDecodeThreads = threads; }
+    void SetNumberOfFilterThreads( unsigned int threads ) { this->NumberOfFilterThreads = threads; }
+
+    // Read and filter the whole series. Throws itk::ExceptionObject if any slice fails to read.
+    vtkSmartPointer<vtkImageData> Load();
+
+    // Histogram of the output of the last Load(), added up by the filter threads as they write it
+    const IntensityHistogram& GetHistogram() const { return this->Histogram; }
+
+private:
+
+    FileNamesContainer FileNames;
+    unsigned int NumberOfDecodeThreads;
+    unsigned int NumberOfFilterThreads;
+    IntensityHistogram Histogram;
+};
+
+#include "PipelinedSeriesLoader.hxx"
+
+#endif /* PipelinedSeriesLoader_h */
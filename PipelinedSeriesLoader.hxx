@@ -0,0 +1,162 @@
+//
+//  PipelinedSeriesLoader.hxx
+//  ImageSlicing
+//
+//  Created by Tom on 16/08/2016.
+//
+//
+
+#ifndef PipelinedSeriesLoader_hxx
+#define PipelinedSeriesLoader_hxx
+
+#include "PipelinedSeriesLoader.h"
+
+#include "BoxCarKernel.h"
+#include "DicomSlabSeriesReader.h"
+
+#include "itkTimeProbe.h"
+#include "vtkTypeTraits.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+template< typename TImage >
+PipelinedSeriesLoader< TImage >::PipelinedSeriesLoader()
+{
+    const unsigned int cores = std::max( 2u, std::thread::hardware_concurrency() );
+    this->NumberOfDecodeThreads = std::max( 1u, cores / 4 );
+    this->NumberOfFilterThreads = std::max( 1u, cores - this->NumberOfDecodeThreads );
+}
+
+template< typename TImage >
+vtkSmartPointer<vtkImageData> PipelinedSeriesLoader< TImage >::Load()
+{
+    itk::TimeProbe clock;
+    clock.Start();
+
+    // Get the geometry from the headers only
+    typedef DicomSlabSeriesReader< TImage > ReaderType;
+    typename ReaderType::Pointer reader = ReaderType::New();
+    reader->SetFileNames( this->FileNames );
+    reader->UpdateOutputInformation();
+    const TImage* header = reader->GetOutput();
+    const typename TImage::SizeType size = header->GetLargestPossibleRegion().GetSize();
+
+    const int nx = static_cast< int >( size[0] );
+    const int ny = static_cast< int >( size[1] );
+    const int nz = static_cast< int >( size[2] );
+    if ( nx < 5 || ny < 5 || nz < 5 )
+    {
+        itkGenericExceptionMacro( << "Series is too small to filter: " << nx << "x" << ny << "x" << nz );
+    }
+
+    vtkSmartPointer<vtkImageData> image = vtkSmartPointer<vtkImageData>::New();
+    // Same extent as the crop at the end of the ITK pipeline in TgwSlicer
+    image->SetExtent( 2, nx - 3, 2, ny - 3, 2, nz - 3 );
+    image->SetSpacing( header->GetSpacing()[0], header->GetSpacing()[1], header->GetSpacing()[2] );
+    image->SetOrigin( header->GetOrigin()[0], header->GetOrigin()[1], header->GetOrigin()[2] );
+    image->AllocateScalars( vtkTypeTraits< PixelType >::VTKTypeID(), 1 );
+    PixelType* output = static_cast< PixelType* >( image->GetScalarPointer() );
+
+    // Staging buffer for the decoded slices
+    const std::size_t planeSize = static_cast< std::size_t >( nx ) * ny;
+    std::vector< PixelType > input( planeSize * nz );
+
+    std::mutex mutex;
+    std::condition_variable sliceDecoded;
+    std::vector< char > decoded( nz, 0 );
+    std::exception_ptr failure;
+    bool failed = false;
+
+    std::atomic< int > nextToDecode( 0 );
+    std::atomic< int > nextToFilter( 2 );
+
+    // Decoders pull files off a shared counter, so the slices become available roughly in Z order
+    auto decode = [&]()
+    {
+        for ( int z = nextToDecode++; z < nz; z = nextToDecode++ )
+        {
+            try
+            {
+                ReaderType::ReadSlice( this->FileNames[z], &input[z * planeSize], planeSize );
+            }
+            catch ( ... )
+            {
+                std::lock_guard< std::mutex > lock( mutex );
+                if ( !failed )
+                {
+                    failure = std::current_exception();
+                    failed = true;
+                }
+                sliceDecoded.notify_all();
+                return;
+            }
+
+            std::lock_guard< std::mutex > lock( mutex );
+            decoded[z] = 1;
+            sliceDecoded.notify_all();
+        }
+    };
+
+    // Filters wait for the slices either side of theirs, then write the inset rows straight into the output,
+    // histogramming each row while it's still in cache
+    this->Histogram.Clear();
+    auto filter = [&]()
+    {
+        IntensityHistogram histogram;
+        for ( int z = nextToFilter++; z < nz - 2; z = nextToFilter++ )
+        {
+            {
+                std::unique_lock< std::mutex > lock( mutex );
+                sliceDecoded.wait( lock, [&]() { return failed || ( decoded[z - 1] && decoded[z] && decoded[z + 1] ); } );
+                if ( failed )
+                {
+                    return;
+                }
+            }
+
+            const PixelType* centre = &input[z * planeSize];
+            PixelType* outputSlice = output + static_cast< std::size_t >( z - 2 ) * ( nx - 4 ) * ( ny - 4 );
+            for ( int j = 2; j < ny - 2; ++j )
+            {
+                const PixelType* row = centre + j * nx + 2;
+                PixelType* outputRow = outputSlice + ( j - 2 ) * ( nx - 4 );
+                BoxCarSmoothRow( row - planeSize, row, row + planeSize, nx, outputRow, nx - 4 );
+                histogram.AddRow( outputRow, nx - 4 );
+            }
+        }
+
+        std::lock_guard< std::mutex > lock( mutex );
+        this->Histogram.Merge( histogram );
+    };
+
+    std::vector< std::thread > threads;
+    for ( unsigned int t = 0; t < this->NumberOfDecodeThreads; ++t )
+    {
+        threads.push_back( std::thread( decode ) );
+    }
+    for ( unsigned int t = 0; t < this->NumberOfFilterThreads; ++t )
+    {
+        threads.push_back( std::thread( filter ) );
+    }
+    for ( std::size_t t = 0; t < threads.size(); ++t )
+    {
+        threads[t].join();
+    }
+
+    if ( failure )
+    {
+        std::rethrow_exception( failure );
+    }
+
+    clock.Stop();
+    std::cout << "Total time for pipelined load and box car filtering: " << clock.GetTotal() << std::endl;
+
+    return image;
+}
+
+#endif /* PipelinedSeriesLoader_hxx */
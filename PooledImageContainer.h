@@ -0,0 +1,85 @@
+//
+//  PooledImageContainer.h
+//  ImageSlicing
+//
+//  Created by Tom on 27/08/2016.
+//
+//
+
+#ifndef PooledImageContainer_h
+#define PooledImageContainer_h
+
+#include <itkImportImageContainer.h>
+
+#include "VolumeBufferPool.h"
+
+#include <algorithm>
+
+/**
+ * An image pixel container that gets its memory from a VolumeBufferPool and gives it back when the image is
+ * re-initialised or destroyed. Put one on an output with SetPixelContainer() before Allocate() and the buffer
+ * the previous update used (which the pipeline dropped in PrepareOutputs) comes straight back.
+ */
+template< typename TElementIdentifier, typename TElement >
+class PooledImageContainer : public itk::ImportImageContainer< TElementIdentifier, TElement >
+{
+public:
+
+    typedef PooledImageContainer Self;
+    typedef itk::ImportImageContainer< TElementIdentifier, TElement > Superclass;
+    typedef itk::SmartPointer<Self> Pointer;
+    typedef itk::SmartPointer<const Self> ConstPointer;
+
+    /** Method for creation through the object factory. */
+    itkNewMacro(Self);
+
+    /** Run-time type information (and related methods). */
+    itkTypeMacro(PooledImageContainer, itk::ImportImageContainer);
+
+    void SetPool( VolumeBufferPool* pool ) { this->m_Pool = pool; }
+    VolumeBufferPool* GetPool() const { return this->m_Pool; }
+
+protected:
+
+    PooledImageContainer() : m_Pool( &VolumeBufferPool::GetGlobalPool() ) {};
+    virtual ~PooledImageContainer()
+    {
+        this->DeallocateManagedMemory();
+    };
+
+    virtual TElement* AllocateElements( TElementIdentifier size, bool UseDefaultConstructor ) const ITK_OVERRIDE
+    {
+        TElement* data = static_cast< TElement* >( this->m_Pool->Acquire( size * sizeof( TElement ) ) );
+        if ( UseDefaultConstructor )
+        {
+            std::fill_n( data, size, TElement() );
+        }
+        return data;
+    }
+
+    virtual void DeallocateManagedMemory() ITK_OVERRIDE
+    {
+        if ( this->GetImportPointer() && this->GetContainerManageMemory() )
+        {
+            this->m_Pool->Release( this->GetImportPointer(), this->Capacity() * sizeof( TElement ) );
+
+            // Let the superclass reset itself without deleting what is now the pool's buffer
+            this->SetContainerManageMemory( false );
+            Superclass::DeallocateManagedMemory();
+            this->SetContainerManageMemory( true );
+        }
+        else
+        {
+            Superclass::DeallocateManagedMemory();
+        }
+    }
+
+private:
+
+    PooledImageContainer(const Self &) ITK_DELETE_FUNCTION;
+    void operator=(const Self &) ITK_DELETE_FUNCTION;
+
+    VolumeBufferPool* m_Pool;
+};
+
+#endif /* PooledImageContainer_h */
@@ -0,0 +1,138 @@
+//
+//  SeriesDirectoryWatcher.cpp
+//  ImageSlicing
+//
+//  Created by Tom on 02/09/2016.
+//
+//
+
+#include "SeriesDirectoryWatcher.h"
+
+#include <cerrno>
+#include <iostream>
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sys/inotify.h>
+#endif
+
+SeriesDirectoryWatcher::SeriesDirectoryWatcher( const std::string& directory )
+: Directory( directory ), Descriptor( -1 )
+{
+#if defined(__linux__)
+    this->Descriptor = inotify_init1( IN_NONBLOCK | IN_CLOEXEC );
+    if ( this->Descriptor >= 0 && inotify_add_watch( this->Descriptor, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO ) < 0 )
+    {
+        close( this->Descriptor );
+        this->Descriptor = -1;
+    }
+#endif
+    if ( this->Descriptor < 0 )
+    {
+        std::cout << "Watching " << directory << " by polling" << std::endl;
+        const std::map< std::string, long long > files = this->ListDirectory();
+        for ( std::map< std::string, long long >::const_iterator file = files.begin(); file != files.end(); ++file )
+        {
+            this->KnownFiles.insert( file->first );
+        }
+    }
+}
+
+SeriesDirectoryWatcher::~SeriesDirectoryWatcher()
+{
+    if ( this->Descriptor >= 0 )
+    {
+        close( this->Descriptor );
+    }
+}
+
+std::vector< std::string > SeriesDirectoryWatcher::GetNewFiles()
+{
+    std::vector< std::string > newFiles;
+
+#if defined(__linux__)
+    if ( this->Descriptor >= 0 )
+    {
+        alignas( inotify_event ) char buffer[16384];
+        for ( ;; )
+        {
+            const ssize_t length = read( this->Descriptor, buffer, sizeof( buffer ) );
+            if ( length < 0 && errno == EINTR )
+            {
+                continue;
+            }
+            if ( length <= 0 )
+            {
+                // EAGAIN: nothing more for now
+                break;
+            }
+            for ( ssize_t offset = 0; offset < length; )
+            {
+                const inotify_event* event = reinterpret_cast< const inotify_event* >( buffer + offset );
+                if ( event->len > 0 && !( event->mask & IN_ISDIR ) && event->name[0] != '.' )
+                {
+                    const std::string path = this->Directory + "/" + event->name;
+                    // A file rewritten in place gets a second close-after-write, only report it once
+                    if ( this->KnownFiles.insert( path ).second )
+                    {
+                        newFiles.push_back( path );
+                    }
+                }
+                offset += sizeof( inotify_event ) + event->len;
+            }
+        }
+        return newFiles;
+    }
+#endif
+
+    // Only once a file has stopped growing between two polls, so that we don't hand over half a slice
+    const std::map< std::string, long long > files = this->ListDirectory();
+    std::map< std::string, long long > pending;
+    for ( std::map< std::string, long long >::const_iterator file = files.begin(); file != files.end(); ++file )
+    {
+        if ( this->KnownFiles.count( file->first ) )
+        {
+            continue;
+        }
+        std::map< std::string, long long >::const_iterator previous = this->PendingSizes.find( file->first );
+        if ( previous != this->PendingSizes.end() && previous->second == file->second && file->second > 0 )
+        {
+            this->KnownFiles.insert( file->first );
+            newFiles.push_back( file->first );
+        }
+        else
+        {
+            pending[file->first] = file->second;
+        }
+    }
+    this->PendingSizes.swap( pending );
+    return newFiles;
+}
+
+std::map< std::string, long long > SeriesDirectoryWatcher::ListDirectory() const
+{
+    std::map< std::string, long long > files;
+    DIR* directory = opendir( this->Directory.c_str() );
+    if ( !directory )
+    {
+        return files;
+    }
+    while ( dirent* entry = readdir( directory ) )
+    {
+        if ( entry->d_name[0] == '.' )
+        {
+            continue;
+        }
+        const std::string path = this->Directory + "/" + entry->d_name;
+        struct stat status;
+        if ( stat( path.c_str(), &status ) == 0 && S_ISREG( status.st_mode ) )
+        {
+            files[path] = static_cast< long long >( status.st_size );
+        }
+    }
+    closedir( directory );
+    return files;
+}
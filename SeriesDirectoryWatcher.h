@@ -0,0 +1,51 @@
+//
+//  SeriesDirectoryWatcher.h
+//  ImageSlicing
+//
+//  Created by Tom on 02/09/2016.
+//
+//
+
+#ifndef SeriesDirectoryWatcher_h
+#define SeriesDirectoryWatcher_h
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+/**
+ * Notices files turning up in a DICOM directory while the scanner is still writing the series. On Linux this
+ * uses inotify and only reports a file once it has been closed after writing (or moved in whole), so we never
+ * pick up half a slice. Elsewhere it falls back to comparing directory listings, and only reports a new file
+ * once its size is the same on two polls running, so a file the scanner is still writing waits for the next
+ * poll after it stops growing.
+ */
+class SeriesDirectoryWatcher
+{
+public:
+
+    explicit SeriesDirectoryWatcher( const std::string& directory );
+    ~SeriesDirectoryWatcher();
+
+    // Full paths of the files that have arrived since the last call (or since construction). Doesn't block.
+    // Files already there when this was made aren't reported, so make it before listing the directory.
+    std::vector< std::string > GetNewFiles();
+
+private:
+
+    SeriesDirectoryWatcher( const SeriesDirectoryWatcher& );
+    void operator=( const SeriesDirectoryWatcher& );
+
+    // Regular files in the directory, and their sizes
+    std::map< std::string, long long > ListDirectory() const;
+
+    std::string Directory;
+    int Descriptor;
+    std::set< std::string > KnownFiles;
+
+    // Polling: files not reported yet, with their size at the last poll
+    std::map< std::string, long long > PendingSizes;
+};
+
+#endif /* SeriesDirectoryWatcher_h */
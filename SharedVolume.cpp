@@ -0,0 +1,246 @@
+//
+//  SharedVolume.cpp
+//  ImageSlicing
+//
+//  Created by Tom on 31/08/2016.
+//
+//
+
+#include "SharedVolume.h"
+
+#include "vtkCallbackCommand.h"
+#include "vtkDataArray.h"
+#include "vtkPointData.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <new>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+    const std::uint32_t Magic = 0x4c4f5654; // "TVOL"
+    const std::uint32_t Version = 2;
+
+    // Shared between processes, so it has to be lock free (and then it's just the 32 bit word)
+    static_assert( ATOMIC_INT_LOCK_FREE == 2 && sizeof( std::atomic< std::uint32_t > ) == sizeof( std::uint32_t ),
+                   "Ready has to be a plain lock free word" );
+
+    struct SharedVolumeHeader
+    {
+        std::uint32_t Magic;
+        std::uint32_t Version;
+        // Stored (release) last, once the voxels are all there, and loaded (acquire) before reading them
+        std::atomic< std::uint32_t > Ready;
+        // Who is writing it, so that a segment abandoned half written can be told from one still being written
+        std::int32_t Publisher;
+        std::int32_t ScalarType;
+        std::int32_t NumberOfComponents;
+        std::int32_t Extent[6];
+        double Spacing[3];
+        double Origin[3];
+        std::uint64_t DataOffset;
+        std::uint64_t DataBytes;
+    };
+
+    // Data starts on a 4 KiB boundary, so it's page aligned in every process
+    const std::uint64_t DataOffset = 4096;
+
+    struct Mapping
+    {
+        void* Address;
+        std::size_t Length;
+    };
+
+    void UnmapSharedVolume( vtkObject*, unsigned long, void* clientData, void* )
+    {
+        Mapping* mapping = static_cast< Mapping* >( clientData );
+        munmap( mapping->Address, mapping->Length );
+        delete mapping;
+    }
+
+    // A segment too small to have a header yet gets this long to grow one before it counts as abandoned
+    const std::time_t AbandonedAfterSeconds = 10;
+
+    // Whether the existing segment will never be finished: not ready, and either its publisher has gone or
+    // (with no header to say who that was) it was created a while ago
+    bool IsAbandoned( const std::string& name )
+    {
+        const int descriptor = shm_open( name.c_str(), O_RDONLY, 0 );
+        if ( descriptor < 0 )
+        {
+            // Gone already, which is just as good
+            return errno == ENOENT;
+        }
+        struct stat status;
+        if ( fstat( descriptor, &status ) != 0 )
+        {
+            close( descriptor );
+            return false;
+        }
+        if ( static_cast< std::uint64_t >( status.st_size ) < sizeof( SharedVolumeHeader ) )
+        {
+            close( descriptor );
+            return std::time( nullptr ) - status.st_mtime > AbandonedAfterSeconds;
+        }
+        void* address = mmap( nullptr, sizeof( SharedVolumeHeader ), PROT_READ, MAP_SHARED, descriptor, 0 );
+        close( descriptor );
+        if ( address == MAP_FAILED )
+        {
+            return false;
+        }
+        const SharedVolumeHeader* header = static_cast< const SharedVolumeHeader* >( address );
+        bool abandoned = false;
+        if ( header->Magic != Magic || header->Version != Version )
+        {
+            // Still zeros from ftruncate, or not one of ours to judge
+            abandoned = header->Magic == 0 && std::time( nullptr ) - status.st_mtime > AbandonedAfterSeconds;
+        }
+        else if ( header->Ready.load( std::memory_order_acquire ) != 1 )
+        {
+            abandoned = kill( static_cast< pid_t >( header->Publisher ), 0 ) != 0 && errno == ESRCH;
+        }
+        munmap( address, sizeof( SharedVolumeHeader ) );
+        return abandoned;
+    }
+}
+
+std::string SharedVolume::GetNameForSeries( const std::string& seriesIdentifier, const std::string& processing )
+{
+    // FNV-1a, since series UIDs can be longer than some systems allow for names
+    const std::string key = seriesIdentifier + "\t" + processing;
+    std::uint64_t hash = 14695981039346656037ULL;
+    for ( std::string::size_type i = 0; i < key.size(); ++i )
+    {
+        hash ^= static_cast< unsigned char >( key[i] );
+        hash *= 1099511628211ULL;
+    }
+    char name[64];
+    std::snprintf( name, sizeof( name ), "/ImageSlicing-%016llx", static_cast< unsigned long long >( hash ) );
+    return name;
+}
+
+bool SharedVolume::Publish( const std::string& name, vtkImageData* volume )
+{
+    vtkDataArray* scalars = volume->GetPointData()->GetScalars();
+    if ( !scalars )
+    {
+        return false;
+    }
+    const std::uint64_t dataBytes = static_cast< std::uint64_t >( scalars->GetNumberOfTuples() )
+                                  * scalars->GetNumberOfComponents() * scalars->GetDataTypeSize();
+    const std::size_t length = static_cast< std::size_t >( DataOffset + dataBytes );
+
+    // O_EXCL so that two loaders racing each other don't write over the same segment. If one is there already
+    // but its publisher died before finishing it, nobody would ever be able to publish the series again, so
+    // clear it away and have another go.
+    int descriptor = shm_open( name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644 );
+    if ( descriptor < 0 && errno == EEXIST && IsAbandoned( name ) )
+    {
+        shm_unlink( name.c_str() );
+        descriptor = shm_open( name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644 );
+    }
+    if ( descriptor < 0 )
+    {
+        return false;
+    }
+    if ( ftruncate( descriptor, static_cast< off_t >( length ) ) != 0 )
+    {
+        close( descriptor );
+        shm_unlink( name.c_str() );
+        return false;
+    }
+    void* address = mmap( nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0 );
+    close( descriptor );
+    if ( address == MAP_FAILED )
+    {
+        shm_unlink( name.c_str() );
+        return false;
+    }
+
+    SharedVolumeHeader* header = new ( address ) SharedVolumeHeader;
+    header->Ready.store( 0, std::memory_order_relaxed );
+    header->Publisher = static_cast< std::int32_t >( getpid() );
+    header->Magic = Magic;
+    header->Version = Version;
+    header->ScalarType = scalars->GetDataType();
+    header->NumberOfComponents = scalars->GetNumberOfComponents();
+    volume->GetExtent( header->Extent );
+    volume->GetSpacing( header->Spacing );
+    volume->GetOrigin( header->Origin );
+    header->DataOffset = DataOffset;
+    header->DataBytes = dataBytes;
+    std::memcpy( static_cast< char* >( address ) + DataOffset, scalars->GetVoidPointer( 0 ), static_cast< std::size_t >( dataBytes ) );
+
+    header->Ready.store( 1, std::memory_order_release );
+
+    munmap( address, length );
+    return true;
+}
+
+vtkSmartPointer<vtkImageData> SharedVolume::Map( const std::string& name )
+{
+    const int descriptor = shm_open( name.c_str(), O_RDONLY, 0 );
+    if ( descriptor < 0 )
+    {
+        return nullptr;
+    }
+    struct stat status;
+    if ( fstat( descriptor, &status ) != 0 || static_cast< std::uint64_t >( status.st_size ) < DataOffset )
+    {
+        close( descriptor );
+        return nullptr;
+    }
+    const std::size_t length = static_cast< std::size_t >( status.st_size );
+    void* address = mmap( nullptr, length, PROT_READ, MAP_SHARED, descriptor, 0 );
+    close( descriptor );
+    if ( address == MAP_FAILED )
+    {
+        return nullptr;
+    }
+
+    const SharedVolumeHeader* header = static_cast< const SharedVolumeHeader* >( address );
+    const bool ready = header->Ready.load( std::memory_order_acquire ) == 1 && header->Magic == Magic && header->Version == Version;
+    if ( !ready || header->DataOffset + header->DataBytes > length )
+    {
+        munmap( address, length );
+        return nullptr;
+    }
+
+    vtkSmartPointer<vtkDataArray> scalars;
+    scalars.TakeReference( vtkDataArray::CreateDataArray( header->ScalarType ) );
+    scalars->SetNumberOfComponents( header->NumberOfComponents );
+    // save = 1 so VTK never tries to free the mapping. Nothing downstream writes to its input's scalars, and
+    // if anything did it would fault rather than change the other processes' view.
+    scalars->SetVoidArray( static_cast< char* >( address ) + header->DataOffset,
+                           static_cast< vtkIdType >( header->DataBytes / scalars->GetDataTypeSize() ), 1 );
+
+    Mapping* mapping = new Mapping;
+    mapping->Address = address;
+    mapping->Length = length;
+    vtkSmartPointer<vtkCallbackCommand> unmap = vtkSmartPointer<vtkCallbackCommand>::New();
+    unmap->SetCallback( UnmapSharedVolume );
+    unmap->SetClientData( mapping );
+    scalars->AddObserver( vtkCommand::DeleteEvent, unmap );
+
+    vtkSmartPointer<vtkImageData> volume = vtkSmartPointer<vtkImageData>::New();
+    volume->SetExtent( const_cast< int* >( header->Extent ) );
+    volume->SetSpacing( header->Spacing[0], header->Spacing[1], header->Spacing[2] );
+    volume->SetOrigin( header->Origin[0], header->Origin[1], header->Origin[2] );
+    volume->GetPointData()->SetScalars( scalars );
+    return volume;
+}
+
+void SharedVolume::Unpublish( const std::string& name )
+{
+    shm_unlink( name.c_str() );
+}
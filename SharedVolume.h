@@ -0,0 +1,47 @@
+//
+//  SharedVolume.h
+//  ImageSlicing
+//
+//  Created by Tom on 31/08/2016.
+//
+//
+
+#ifndef SharedVolume_h
+#define SharedVolume_h
+
+#include "vtkSmartPointer.h"
+#include "vtkImageData.h"
+
+#include <string>
+
+/**
+ * Hands a decoded (and filtered) volume from one process to others through a named POSIX shared memory
+ * segment, so several viewers on the same machine don't each decode the series and keep their own copy.
+ * The segment is a small header (extent, spacing, origin, scalar type) followed by the voxels.
+ *
+ * Publish() copies the volume in once. Map() gives back a vtkImageData whose scalars point straight at the
+ * (read-only) mapping, which is unmapped again when the scalars are deleted. The publisher owns the name and
+ * should Unpublish() it when it's done (e.g. on exit): viewers that have already mapped the volume keep it
+ * until they let go of it, later ones load the series themselves. A segment left half written by a publisher
+ * that died is cleared away by the next Publish() under that name.
+ */
+class SharedVolume
+{
+public:
+
+    // Segment name for a series, e.g. "/ImageSlicing-1a2b3c4d5e6f7081". processing has to tell apart the
+    // different ways of making a volume from the series (cropped or not, slab, empty-brick filling...), since
+    // they give different extents or voxels and mustn't be mistaken for each other.
+    static std::string GetNameForSeries( const std::string& seriesIdentifier, const std::string& processing );
+
+    // Create the segment and copy the volume into it. Returns false if it couldn't be created, including
+    // when another live process has already published (or is publishing) under that name.
+    static bool Publish( const std::string& name, vtkImageData* volume );
+
+    // The published volume, or null if there is no such segment (or it's still being written)
+    static vtkSmartPointer<vtkImageData> Map( const std::string& name );
+
+    static void Unpublish( const std::string& name );
+};
+
+#endif /* SharedVolume_h */
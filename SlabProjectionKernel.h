@@ -0,0 +1,120 @@
+//
+//  SlabProjectionKernel.h
+//  ImageSlicing
+//
+//  Created by Tom on 05/09/2016.
+//
+//
+
+#ifndef SlabProjectionKernel_h
+#define SlabProjectionKernel_h
+
+#include "BoxCarKernel.h"
+
+#include <algorithm>
+#include <cstddef>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// What to do along the slab normal
+enum SlabProjectionMode
+{
+    SlabProjectionMaximum = 0,
+    SlabProjectionMinimum = 1,
+    SlabProjectionMean = 2
+};
+
+// Plain version of SlabProjectRow, for any pixel type
+template< typename TPixel >
+inline void SlabProjectRowScalar( const TPixel* first, std::ptrdiff_t sliceStride, int numberOfSlices, SlabProjectionMode mode,
+                                  TPixel* output, std::size_t count )
+{
+    typedef typename BoxCarAccumulator< TPixel >::Type AccumulatorType;
+
+    const float inverse = 1.0f / numberOfSlices;
+    for ( std::size_t i = 0; i < count; ++i )
+    {
+        const TPixel* voxel = first + i;
+        if ( mode == SlabProjectionMean )
+        {
+            AccumulatorType sum = 0;
+            for ( int s = 0; s < numberOfSlices; ++s, voxel += sliceStride )
+            {
+                sum += *voxel;
+            }
+            output[i] = static_cast< TPixel >( static_cast< float >( sum ) * inverse );
+        }
+        else
+        {
+            TPixel value = *voxel;
+            for ( int s = 1; s < numberOfSlices; ++s )
+            {
+                voxel += sliceStride;
+                value = ( mode == SlabProjectionMaximum ) ? std::max( value, *voxel ) : std::min( value, *voxel );
+            }
+            output[i] = value;
+        }
+    }
+}
+
+/**
+ * Project count voxels of a row through a slab of numberOfSlices slices: first points at the row in the first
+ * slice, and the same row in slice s is at first + s * sliceStride. The mean is the float sum times 1/n,
+ * truncated, which the SSE2 version below reproduces exactly.
+ */
+template< typename TPixel >
+inline void SlabProjectRow( const TPixel* first, std::ptrdiff_t sliceStride, int numberOfSlices, SlabProjectionMode mode,
+                            TPixel* output, std::size_t count )
+{
+    SlabProjectRowScalar( first, sliceStride, numberOfSlices, mode, output, count );
+}
+
+#if defined(__SSE2__)
+// CT is signed 16 bit, so that gets done eight voxels at a time
+template<>
+inline void SlabProjectRow< short >( const short* first, std::ptrdiff_t sliceStride, int numberOfSlices, SlabProjectionMode mode,
+                                     short* output, std::size_t count )
+{
+    const std::size_t vectorCount = count & ~std::size_t( 7 );
+    const __m128 inverse = _mm_set1_ps( 1.0f / numberOfSlices );
+
+    for ( std::size_t i = 0; i < vectorCount; i += 8 )
+    {
+        const short* voxel = first + i;
+        __m128i result;
+        if ( mode == SlabProjectionMean )
+        {
+            // Sign extend to 32 bits and sum in two halves
+            __m128i low = _mm_setzero_si128();
+            __m128i high = _mm_setzero_si128();
+            for ( int s = 0; s < numberOfSlices; ++s, voxel += sliceStride )
+            {
+                const __m128i v = _mm_loadu_si128( reinterpret_cast< const __m128i* >( voxel ) );
+                low = _mm_add_epi32( low, _mm_srai_epi32( _mm_unpacklo_epi16( v, v ), 16 ) );
+                high = _mm_add_epi32( high, _mm_srai_epi32( _mm_unpackhi_epi16( v, v ), 16 ) );
+            }
+            low = _mm_cvttps_epi32( _mm_mul_ps( _mm_cvtepi32_ps( low ), inverse ) );
+            high = _mm_cvttps_epi32( _mm_mul_ps( _mm_cvtepi32_ps( high ), inverse ) );
+            result = _mm_packs_epi32( low, high );
+        }
+        else
+        {
+            result = _mm_loadu_si128( reinterpret_cast< const __m128i* >( voxel ) );
+            for ( int s = 1; s < numberOfSlices; ++s )
+            {
+                voxel += sliceStride;
+                const __m128i v = _mm_loadu_si128( reinterpret_cast< const __m128i* >( voxel ) );
+                result = ( mode == SlabProjectionMaximum ) ? _mm_max_epi16( result, v ) : _mm_min_epi16( result, v );
+            }
+        }
+        _mm_storeu_si128( reinterpret_cast< __m128i* >( output + i ), result );
+    }
+
+    // The last few voxels of the row
+    SlabProjectRowScalar( first + vectorCount, sliceStride, numberOfSlices, mode, output + vectorCount, count - vectorCount );
+}
+#endif
+
+#endif /* SlabProjectionKernel_h */
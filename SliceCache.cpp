@@ -0,0 +1,241 @@
+//
+//  SliceCache.cpp
+//  ImageSlicing
+//
+//  Created by Tom on 09/09/2016.
+//
+//
+
+#include "SliceCache.h"
+
+#include "vtkImageMapToColors.h"
+#include "vtkImageReslice.h"
+#include "vtkInformation.h"
+#include "vtkMatrix4x4.h"
+#include "vtkScalarsToColors.h"
+#include "vtkStreamingDemandDrivenPipeline.h"
+
+#include "vtkImageSlabProjection.hpp"
+#include "SliceRenderer.h"
+
+#include <cmath>
+
+// Everything the worker needs, built on the calling thread and then only touched by the worker
+struct SliceCache::PrefetchJob
+{
+    unsigned long Generation;
+    std::shared_ptr< SliceRenderer > Renderer;
+    std::vector< Key > Keys;
+};
+
+SliceCache::Key::Key( vtkMatrix4x4* axes, vtkImageReslice* reslice, vtkImageSlabProjection* slabProjection, vtkImageMapToColors* colors )
+{
+    // Thousandths of a millimetre for the position is well below a slice, and plenty for the directions
+    for ( int i = 0; i < 16; ++i )
+    {
+        this->Axes[i] = axes->GetElement( i / 4, i % 4 );
+        this->Values.push_back( std::llround( this->Axes[i] * 1000.0 ) );
+    }
+
+    // A slab is as thick as the slices the reslice makes for it
+    double thickness = 0.0;
+    if ( slabProjection )
+    {
+        vtkInformation* outInfo = reslice->GetOutputInformation( 0 );
+        int extent[6];
+        outInfo->Get( vtkStreamingDemandDrivenPipeline::WHOLE_EXTENT(), extent );
+        thickness = ( extent[5] - extent[4] + 1 ) * outInfo->Get( vtkDataObject::SPACING() )[2];
+    }
+    this->Values.push_back( slabProjection ? slabProjection->GetMode() : -1 );
+    this->Values.push_back( std::llround( thickness * 1000.0 ) );
+
+    const double* range = colors->GetLookupTable()->GetRange();
+    this->Values.push_back( std::llround( ( range[1] - range[0] ) * 1000.0 ) );
+    this->Values.push_back( std::llround( 0.5 * ( range[0] + range[1] ) * 1000.0 ) );
+    this->Values.push_back( colors->GetOutputFormat() );
+}
+
+SliceCache::SliceCache()
+{
+    this->MaximumNumberOfSlices = 64;
+    this->PrefetchDepth = 8;
+    this->NumberOfHits = 0;
+    this->NumberOfMisses = 0;
+    this->Generation = 0;
+    this->Working = false;
+    this->Stopping = false;
+    this->Worker = std::thread( &SliceCache::PrefetchLoop, this );
+}
+
+SliceCache::~SliceCache()
+{
+    {
+        std::lock_guard< std::mutex > lock( this->Mutex );
+        this->Stopping = true;
+        ++this->Generation;
+    }
+    this->WorkAvailable.notify_all();
+    this->Worker.join();
+}
+
+void SliceCache::SetMaximumNumberOfSlices( std::size_t slices )
+{
+    std::lock_guard< std::mutex > lock( this->Mutex );
+    this->MaximumNumberOfSlices = slices;
+    while ( this->Slices.size() > this->MaximumNumberOfSlices )
+    {
+        this->Slices.erase( this->LruOrder.back() );
+        this->LruOrder.pop_back();
+    }
+}
+
+std::size_t SliceCache::GetNumberOfHits() const
+{
+    std::lock_guard< std::mutex > lock( this->Mutex );
+    return this->NumberOfHits;
+}
+
+std::size_t SliceCache::GetNumberOfMisses() const
+{
+    std::lock_guard< std::mutex > lock( this->Mutex );
+    return this->NumberOfMisses;
+}
+
+vtkSmartPointer<vtkImageData> SliceCache::Find( const Key& key )
+{
+    std::lock_guard< std::mutex > lock( this->Mutex );
+    auto found = this->Slices.find( key );
+    if ( found == this->Slices.end() )
+    {
+        ++this->NumberOfMisses;
+        return vtkSmartPointer<vtkImageData>();
+    }
+
+    ++this->NumberOfHits;
+    this->LruOrder.splice( this->LruOrder.begin(), this->LruOrder, found->second.second );
+    return found->second.first;
+}
+
+void SliceCache::Insert( const Key& key, vtkImageData* image )
+{
+    vtkSmartPointer<vtkImageData> copy = vtkSmartPointer<vtkImageData>::New();
+    copy->DeepCopy( image );
+
+    std::lock_guard< std::mutex > lock( this->Mutex );
+    this->InsertLocked( key, copy );
+}
+
+void SliceCache::InsertLocked( const Key& key, vtkSmartPointer<vtkImageData> image )
+{
+    auto found = this->Slices.find( key );
+    if ( found != this->Slices.end() )
+    {
+        found->second.first = image;
+        this->LruOrder.splice( this->LruOrder.begin(), this->LruOrder, found->second.second );
+        return;
+    }
+
+    this->LruOrder.push_front( key );
+    this->Slices[key] = std::make_pair( image, this->LruOrder.begin() );
+    while ( this->Slices.size() > this->MaximumNumberOfSlices )
+    {
+        this->Slices.erase( this->LruOrder.back() );
+        this->LruOrder.pop_back();
+    }
+}
+
+void SliceCache::Prefetch( vtkImageReslice* reslice, vtkImageSlabProjection* slabProjection, vtkImageMapToColors* colors, int direction )
+{
+    if ( !reslice->GetInput() || this->PrefetchDepth == 0 )
+    {
+        return;
+    }
+
+    // Only copy the pipeline again if something other than the axes has changed. A job still using the old
+    // copy keeps it alive until it's done.
+    if ( !this->Renderer || !this->Renderer->Matches( reslice, slabProjection, colors ) )
+    {
+        this->Renderer = std::make_shared< SliceRenderer >( reslice, slabProjection, colors );
+    }
+    std::unique_ptr< PrefetchJob > job( new PrefetchJob );
+    job->Renderer = this->Renderer;
+
+    // Nearest first, one slice spacing apart along the normal
+    const double sliceSpacing = job->Renderer->GetSliceSpacing();
+    vtkMatrix4x4* current = reslice->GetResliceAxes();
+    vtkSmartPointer<vtkMatrix4x4> axes = vtkSmartPointer<vtkMatrix4x4>::New();
+    axes->DeepCopy( current );
+    for ( unsigned int step = 1; step <= this->PrefetchDepth; ++step )
+    {
+        const double point[4] = { 0.0, 0.0, direction * sliceSpacing * step, 1.0 };
+        double center[4];
+        current->MultiplyPoint( point, center );
+        axes->SetElement( 0, 3, center[0] );
+        axes->SetElement( 1, 3, center[1] );
+        axes->SetElement( 2, 3, center[2] );
+        job->Keys.push_back( Key( axes, reslice, slabProjection, colors ) );
+    }
+
+    {
+        std::lock_guard< std::mutex > lock( this->Mutex );
+        job->Generation = ++this->Generation;
+        this->PendingJob = std::move( job );
+    }
+    this->WorkAvailable.notify_one();
+}
+
+void SliceCache::Clear()
+{
+    std::unique_lock< std::mutex > lock( this->Mutex );
+    ++this->Generation;
+    this->PendingJob.reset();
+    this->WorkFinished.wait( lock, [this] { return !this->Working; } );
+
+    this->Slices.clear();
+    this->LruOrder.clear();
+
+    // Our copy of the pipeline holds on to the volume as well
+    this->Renderer.reset();
+}
+
+void SliceCache::PrefetchLoop()
+{
+    std::unique_lock< std::mutex > lock( this->Mutex );
+    for ( ;; )
+    {
+        this->WorkAvailable.wait( lock, [this] { return this->Stopping || this->PendingJob; } );
+        if ( this->Stopping )
+        {
+            return;
+        }
+
+        std::unique_ptr< PrefetchJob > job = std::move( this->PendingJob );
+        this->Working = true;
+
+        for ( std::size_t i = 0; i < job->Keys.size() && job->Generation == this->Generation; ++i )
+        {
+            const Key& key = job->Keys[i];
+            if ( this->Slices.count( key ) )
+            {
+                continue;
+            }
+
+            lock.unlock();
+            vtkSmartPointer<vtkImageData> slice = job->Renderer->Render( key.Axes );
+            lock.lock();
+
+            // Don't keep slices for something that has been cleared away in the meantime
+            if ( job->Generation == this->Generation )
+            {
+                this->InsertLocked( key, slice );
+            }
+        }
+
+        // The pipeline holds a reference to the volume, so let it go before saying we're done
+        lock.unlock();
+        job.reset();
+        lock.lock();
+        this->Working = false;
+        this->WorkFinished.notify_all();
+    }
+}
@@ -0,0 +1,117 @@
+//
+//  SliceCache.h
+//  ImageSlicing
+//
+//  Created by Tom on 09/09/2016.
+//
+//
+
+#ifndef SliceCache_h
+#define SliceCache_h
+
+#include "vtkSmartPointer.h"
+#include "vtkImageData.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class vtkImageMapToColors;
+class vtkImageReslice;
+class vtkImageSlabProjection;
+class vtkMatrix4x4;
+class SliceRenderer;
+
+/**
+ * The last few finished (coloured) slices, keyed by the reslice axes, slab and window/level they were made
+ * with, so that scrolling back over them is just a matter of showing that image rather than reslicing. A
+ * background thread fills it ahead of the user: Prefetch() drops whatever it was doing and starts making the
+ * next slices in the direction they are scrolling, with its own copy of the reslice/colour pipeline. That copy
+ * is kept from one Prefetch() to the next, and only made again when the volume, lookup table, slab or output
+ * geometry changes, so a prefetch while scrolling costs no more than working out the axes.
+ */
+class SliceCache
+{
+public:
+
+    // Slice position, slab (mode and thickness) and colouring, rounded so that positions reached by different
+    // routes compare equal. The reslice is only looked at for its output geometry, not its axes.
+    class Key
+    {
+    public:
+        Key( vtkMatrix4x4* axes, vtkImageReslice* reslice, vtkImageSlabProjection* slabProjection, vtkImageMapToColors* colors );
+        bool operator<( const Key& other ) const { return this->Values < other.Values; }
+
+        // The axes it was made from (unrounded)
+        double Axes[16];
+
+    private:
+        std::vector< long long > Values;
+    };
+
+    SliceCache();
+    ~SliceCache();
+
+    // Least recently used slices are dropped beyond this
+    void SetMaximumNumberOfSlices( std::size_t slices );
+
+    // How many slices ahead Prefetch() goes
+    void SetPrefetchDepth( unsigned int depth ) { this->PrefetchDepth = depth; }
+    unsigned int GetPrefetchDepth() const { return this->PrefetchDepth; }
+
+    // The finished slice, or null
+    vtkSmartPointer<vtkImageData> Find( const Key& key );
+
+    // Keeps a copy of image
+    void Insert( const Key& key, vtkImageData* image );
+
+    // Start making the next GetPrefetchDepth() slices, each one slice spacing further along the reslice
+    // normal in the given direction (+1 or -1) from the current axes, with the same settings as the given
+    // pipeline (which must have been updated at least once). Anything already queued is abandoned.
+    void Prefetch( vtkImageReslice* reslice, vtkImageSlabProjection* slabProjection, vtkImageMapToColors* colors, int direction );
+
+    // Stop prefetching (waiting for the slice being made to finish) and forget everything. Call before the
+    // volume's voxels go anywhere.
+    void Clear();
+
+    std::size_t GetNumberOfHits() const;
+    std::size_t GetNumberOfMisses() const;
+
+private:
+
+    SliceCache( const SliceCache& );
+    void operator=( const SliceCache& );
+
+    struct PrefetchJob;
+
+    void PrefetchLoop();
+    void InsertLocked( const Key& key, vtkSmartPointer<vtkImageData> image );
+
+    mutable std::mutex Mutex;
+    std::condition_variable WorkAvailable;
+    std::condition_variable WorkFinished;
+
+    std::map< Key, std::pair< vtkSmartPointer<vtkImageData>, std::list< Key >::iterator > > Slices;
+    std::list< Key > LruOrder;
+    std::size_t MaximumNumberOfSlices;
+    unsigned int PrefetchDepth;
+    std::size_t NumberOfHits;
+    std::size_t NumberOfMisses;
+
+    // The private pipeline, which only the calling thread replaces; jobs share it, and the worker only ever
+    // runs one job at a time
+    std::shared_ptr< SliceRenderer > Renderer;
+
+    std::unique_ptr< PrefetchJob > PendingJob;
+    unsigned long Generation;
+    bool Working;
+    bool Stopping;
+    std::thread Worker;
+};
+
+#endif /* SliceCache_h */
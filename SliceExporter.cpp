@@ -0,0 +1,274 @@
+//
+//  SliceExporter.cpp
+//  ImageSlicing
+//
+//  Created by Tom on 16/09/2016.
+//
+//
+
+#include "SliceExporter.h"
+
+#include "itkMacro.h"
+#include "itkTimeProbe.h"
+
+#include "vtkErrorCode.h"
+#include "vtkImageMapToWindowLevelColors.h"
+#include "vtkImageReslice.h"
+#include "vtkMatrix4x4.h"
+#include "vtkPNGWriter.h"
+
+#include "IntensityHistogram.h"
+#include "SliceServer.h"
+#include "WorkStealingExecutor.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+namespace
+{
+    struct Orientation
+    {
+        const char* Name;
+        double Axes[9];
+    };
+
+    // Rows are x, y, z in world coordinates; the columns are the slice's x and y directions and its normal
+    const Orientation Orientations[] = {
+        { "axial",    { 1, 0, 0,   0, 1, 0,   0, 0, 1 } },
+        { "coronal",  { 1, 0, 0,   0, 0, 1,   0, -1, 0 } },
+        { "sagittal", { 0, 0, -1,  1, 0, 0,   0, -1, 0 } } };
+    const unsigned int NumberOfOrientations = sizeof( Orientations ) / sizeof( Orientations[0] );
+}
+
+SliceExporter::SliceExporter()
+{
+    this->NumberOfSlices = 8;
+    this->Montage = false;
+    this->HaveWindowLevel = false;
+    this->Window = 0.0;
+    this->Level = 0.0;
+    this->NumberOfThreads = 0;
+}
+
+void SliceExporter::SetWindowLevel( double window, double level )
+{
+    this->Window = window;
+    this->Level = level;
+    this->HaveWindowLevel = true;
+}
+
+int SliceExporter::Run()
+{
+    if ( this->NumberOfSlices == 0 )
+    {
+        std::cerr << "Nothing to export" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    itk::TimeProbe loadClock, sliceClock, writeClock;
+    loadClock.Start();
+    IntensityHistogram histogram;
+    vtkSmartPointer<vtkImageData> volume;
+    try
+    {
+        volume = SliceServer::LoadSeries( this->Directory, this->SeriesIdentifier, &histogram );
+    }
+    catch ( itk::ExceptionObject& ex )
+    {
+        std::cerr << ex << std::endl;
+        return EXIT_FAILURE;
+    }
+    loadClock.Stop();
+
+    double window = this->Window, level = this->Level;
+    if ( !this->HaveWindowLevel )
+    {
+        if ( !histogram.IsEmpty() )
+        {
+            const IntensityHistogram::WindowLevelPreset preset = histogram.GetWindowLevelPresets().front();
+            window = preset.Window;
+            level = preset.Level;
+        }
+        else
+        {
+            const double* range = volume->GetScalarRange();
+            window = std::max( 1.0, range[1] - range[0] );
+            level = 0.5 * ( range[0] + range[1] );
+        }
+    }
+
+    // Evenly spaced through the middle of the volume: slice i of n sits at (i + 0.5) / n of the way along the
+    // normal, so none of them are on the very edge
+    double bounds[6];
+    volume->GetBounds( bounds );
+    const double centre[3] = { 0.5 * ( bounds[0] + bounds[1] ), 0.5 * ( bounds[2] + bounds[3] ), 0.5 * ( bounds[4] + bounds[5] ) };
+
+    const std::size_t total = NumberOfOrientations * this->NumberOfSlices;
+    std::vector< vtkSmartPointer<vtkImageData> > slices( total );
+    
+    // A data object of its own for each task, sharing the voxels. Made here, since shallow copies of the same
+    // volume from several threads at once aren't safe.
+    std::vector< vtkSmartPointer<vtkImageData> > inputs( total );
+    for ( std::size_t index = 0; index < total; ++index )
+    {
+        inputs[index] = vtkSmartPointer<vtkImageData>::New();
+        inputs[index]->ShallowCopy( volume );
+    }
+
+    // Set by each task whose PNG couldn't be written (one entry each, so no locking)
+    std::vector< char > failed( total, 0 );
+
+    std::vector< WorkStealingExecutor::TaskType > tasks;
+    for ( unsigned int o = 0; o < NumberOfOrientations; ++o )
+    {
+        for ( unsigned int i = 0; i < this->NumberOfSlices; ++i )
+        {
+            double position[3] = { centre[0], centre[1], centre[2] };
+            for ( int d = 0; d < 3; ++d )
+            {
+                // The normal is always along one of the world axes here
+                if ( Orientations[o].Axes[3 * d + 2] != 0.0 )
+                {
+                    position[d] = bounds[2 * d] + ( i + 0.5 ) / this->NumberOfSlices * ( bounds[2 * d + 1] - bounds[2 * d] );
+                }
+            }
+
+            const std::size_t index = o * this->NumberOfSlices + i;
+            const bool montage = this->Montage;
+            char fileName[32];
+            std::snprintf( fileName, sizeof( fileName ), "_%s_%03u.png", Orientations[o].Name, i );
+            const std::string path = this->OutputPrefix + fileName;
+
+            tasks.push_back( [&slices, &inputs, &failed, o, index, position, window, level, montage, path]()
+            {
+                slices[index] = SliceExporter::RenderSlice( inputs[index], Orientations[o].Axes, position, window, level );
+                if ( !montage )
+                {
+                    vtkSmartPointer<vtkPNGWriter> writer = vtkSmartPointer<vtkPNGWriter>::New();
+                    writer->SetInputData( slices[index] );
+                    writer->SetFileName( path.c_str() );
+                    writer->Write();
+                    failed[index] = writer->GetErrorCode() != vtkErrorCode::NoError;
+                }
+            } );
+        }
+    }
+
+    sliceClock.Start();
+    WorkStealingExecutor executor( this->NumberOfThreads );
+    executor.Run( tasks );
+    sliceClock.Stop();
+
+    const std::size_t failures = std::count( failed.begin(), failed.end(), 1 );
+    if ( failures != 0 )
+    {
+        std::cerr << "Couldn't write " << failures << " of " << total << " slices to " << this->OutputPrefix << "_*.png" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if ( this->Montage )
+    {
+        writeClock.Start();
+        const std::string path = this->OutputPrefix + "_montage.png";
+        vtkSmartPointer<vtkPNGWriter> writer = vtkSmartPointer<vtkPNGWriter>::New();
+        writer->SetInputData( SliceExporter::MakeMontage( slices, this->NumberOfSlices ) );
+        writer->SetFileName( path.c_str() );
+        writer->Write();
+        writeClock.Stop();
+        if ( writer->GetErrorCode() != vtkErrorCode::NoError )
+        {
+            std::cerr << "Couldn't write " << path << ": " << vtkErrorCode::GetStringFromErrorCode( writer->GetErrorCode() ) << std::endl;
+            return EXIT_FAILURE;
+        }
+        std::cout << "Wrote " << path << std::endl;
+    }
+    else
+    {
+        std::cout << "Wrote " << total << " slices to " << this->OutputPrefix << "_*.png" << std::endl;
+    }
+
+    std::cout << "Window/level " << window << " / " << level << std::endl;
+    std::cout << "Load: " << loadClock.GetTotal() << ", slices" << ( this->Montage ? "" : " (including PNG encoding)" ) << ": "
+              << sliceClock.GetTotal() << " on " << executor.GetNumberOfThreads() << " threads";
+    if ( this->Montage )
+    {
+        std::cout << ", montage: " << writeClock.GetTotal();
+    }
+    std::cout << std::endl;
+    return EXIT_SUCCESS;
+}
+
+vtkSmartPointer<vtkImageData> SliceExporter::RenderSlice( vtkImageData* volume, const double axes[9], const double position[3],
+                                                          double window, double level )
+{
+    vtkSmartPointer<vtkMatrix4x4> resliceAxes = vtkSmartPointer<vtkMatrix4x4>::New();
+    for ( int i = 0; i < 3; ++i )
+    {
+        for ( int j = 0; j < 3; ++j )
+        {
+            resliceAxes->SetElement( i, j, axes[3 * i + j] );
+        }
+        resliceAxes->SetElement( i, 3, position[i] );
+    }
+
+    // We're already running one slice per core, so more threads per slice would only get in each other's way
+    vtkSmartPointer<vtkImageReslice> reslice = vtkSmartPointer<vtkImageReslice>::New();
+    reslice->SetInputData( volume );
+    reslice->SetOutputDimensionality( 2 );
+    reslice->SetResliceAxes( resliceAxes );
+    reslice->SetInterpolationModeToLinear();
+    reslice->SetNumberOfThreads( 1 );
+
+    vtkSmartPointer<vtkImageMapToWindowLevelColors> windowLevel = vtkSmartPointer<vtkImageMapToWindowLevelColors>::New();
+    windowLevel->SetInputConnection( reslice->GetOutputPort() );
+    windowLevel->SetWindow( window );
+    windowLevel->SetLevel( level );
+    windowLevel->SetOutputFormatToLuminance();
+    windowLevel->SetNumberOfThreads( 1 );
+    windowLevel->Update();
+
+    vtkSmartPointer<vtkImageData> slice = vtkSmartPointer<vtkImageData>::New();
+    slice->ShallowCopy( windowLevel->GetOutput() );
+    return slice;
+}
+
+vtkSmartPointer<vtkImageData> SliceExporter::MakeMontage( const std::vector< vtkSmartPointer<vtkImageData> >& slices, unsigned int columns )
+{
+    int cellWidth = 1, cellHeight = 1;
+    for ( std::size_t s = 0; s < slices.size(); ++s )
+    {
+        int dimensions[3];
+        slices[s]->GetDimensions( dimensions );
+        cellWidth = std::max( cellWidth, dimensions[0] );
+        cellHeight = std::max( cellHeight, dimensions[1] );
+    }
+    columns = std::max( 1u, columns );
+    const int rows = static_cast< int >( ( slices.size() + columns - 1 ) / columns );
+
+    vtkSmartPointer<vtkImageData> montage = vtkSmartPointer<vtkImageData>::New();
+    montage->SetDimensions( cellWidth * columns, cellHeight * rows, 1 );
+    montage->AllocateScalars( VTK_UNSIGNED_CHAR, 1 );
+    unsigned char* output = static_cast< unsigned char* >( montage->GetScalarPointer() );
+    const std::size_t montageWidth = static_cast< std::size_t >( cellWidth ) * columns;
+    std::memset( output, 0, montageWidth * cellHeight * rows );
+
+    // VTK images start at the bottom, so the first row of slices goes at the top
+    for ( std::size_t s = 0; s < slices.size(); ++s )
+    {
+        int dimensions[3];
+        slices[s]->GetDimensions( dimensions );
+        const int column = static_cast< int >( s % columns );
+        const int row = rows - 1 - static_cast< int >( s / columns );
+        const int x0 = column * cellWidth + ( cellWidth - dimensions[0] ) / 2;
+        const int y0 = row * cellHeight + ( cellHeight - dimensions[1] ) / 2;
+        const unsigned char* input = static_cast< const unsigned char* >( slices[s]->GetScalarPointer() );
+        for ( int y = 0; y < dimensions[1]; ++y )
+        {
+            std::memcpy( output + ( y0 + y ) * montageWidth + x0, input + static_cast< std::size_t >( y ) * dimensions[0], dimensions[0] );
+        }
+    }
+    return montage;
+}
@@ -0,0 +1,71 @@
+//
+//  SliceExporter.h
+//  ImageSlicing
+//
+//  Created by Tom on 16/09/2016.
+//
+//
+
+#ifndef SliceExporter_h
+#define SliceExporter_h
+
+#include "vtkSmartPointer.h"
+#include "vtkImageData.h"
+
+#include <string>
+#include <vector>
+
+/**
+ * Headless preview export: loads a series (as SliceServer does), then reslices and window/levels
+ * GetNumberOfSlices() evenly spaced slices in each of the axial, coronal and sagittal orientations, and writes
+ * them out as greyscale PNGs, either one file per slice (<prefix>_axial_000.png ...) or as a single montage
+ * (<prefix>_montage.png) with a row per orientation. There's no render window anywhere, so it runs on machines
+ * without a display.
+ *
+ * The slices are independent, so they're made in parallel on a WorkStealingExecutor, one slice per task, each
+ * with its own single threaded reslice and colouring (and its own PNG writer when writing separate files).
+ *
+ * Unless SetWindowLevel is used, the window/level is the "Auto" preset from the loader's histogram (see
+ * IntensityHistogram), or the full scalar range if the volume came from shared memory.
+ */
+class SliceExporter
+{
+public:
+
+    SliceExporter();
+
+    void SetDirectory( const std::string& directory ) { this->Directory = directory; }
+    void SetSeriesIdentifier( const std::string& seriesIdentifier ) { this->SeriesIdentifier = seriesIdentifier; }
+    void SetOutputPrefix( const std::string& prefix ) { this->OutputPrefix = prefix; }
+    void SetNumberOfSlices( unsigned int slices ) { this->NumberOfSlices = slices; }
+    void SetMontage( bool montage ) { this->Montage = montage; }
+    void SetWindowLevel( double window, double level );
+    void SetNumberOfThreads( unsigned int threads ) { this->NumberOfThreads = threads; }
+
+    // Load, slice and write. Returns EXIT_FAILURE (having said why) if anything goes wrong.
+    int Run();
+
+    // Window/levelled slice through the volume, perpendicular to the third column of axes (row by row, as
+    // for SliceServer) through position. The pipeline stores its information on volume, so calls running at
+    // the same time each need their own data object (a shallow copy, made before they start).
+    static vtkSmartPointer<vtkImageData> RenderSlice( vtkImageData* volume, const double axes[9], const double position[3],
+                                                      double window, double level );
+
+    // Tile the slices into one image, a row of columns slices at a time, each centred in a cell as big as the
+    // biggest slice
+    static vtkSmartPointer<vtkImageData> MakeMontage( const std::vector< vtkSmartPointer<vtkImageData> >& slices, unsigned int columns );
+
+private:
+
+    std::string Directory;
+    std::string SeriesIdentifier;
+    std::string OutputPrefix;
+    unsigned int NumberOfSlices;
+    bool Montage;
+    bool HaveWindowLevel;
+    double Window;
+    double Level;
+    unsigned int NumberOfThreads;
+};
+
+#endif /* SliceExporter_h */
@@ -0,0 +1,122 @@
+//
+//  SliceRenderer.cpp
+//  ImageSlicing
+//
+//  Created by Tom on 12/09/2016.
+//
+//
+
+#include "SliceRenderer.h"
+
+#include "vtkImageMapToColors.h"
+#include "vtkImageReslice.h"
+#include "vtkInformation.h"
+#include "vtkMatrix4x4.h"
+#include "vtkScalarsToColors.h"
+#include "vtkStreamingDemandDrivenPipeline.h"
+
+#include "vtkImageCompressedReslice.hpp"
+#include "vtkImageSlabProjection.hpp"
+
+#include <cmath>
+#include <cstdint>
+
+SliceRenderer::SliceRenderer( vtkImageReslice* reslice, vtkImageSlabProjection* slabProjection, vtkImageMapToColors* colors )
+: Description( DescribePipeline( reslice, slabProjection, colors ) )
+{
+    // Our own data object for the volume, sharing its voxels
+    vtkSmartPointer<vtkImageData> volume = vtkSmartPointer<vtkImageData>::New();
+    volume->ShallowCopy( reslice->GetInput() );
+
+    vtkInformation* outInfo = reslice->GetOutputInformation( 0 );
+    int extent[6];
+    outInfo->Get( vtkStreamingDemandDrivenPipeline::WHOLE_EXTENT(), extent );
+    this->SliceSpacing = outInfo->Get( vtkDataObject::SPACING() )[2];
+
+    this->Axes = vtkSmartPointer<vtkMatrix4x4>::New();
+    this->Axes->DeepCopy( reslice->GetResliceAxes() );
+    this->Reslice.TakeReference( reslice->NewInstance() );
+    this->Reslice->SetInputData( volume );
+    this->Reslice->SetResliceAxes( this->Axes );
+    this->Reslice->SetOutputDimensionality( reslice->GetOutputDimensionality() );
+    this->Reslice->SetInterpolationMode( reslice->GetInterpolationMode() );
+    this->Reslice->SetBackgroundLevel( reslice->GetBackgroundLevel() );
+    this->Reslice->SetOutputExtent( extent );
+    this->Reslice->SetOutputSpacing( outInfo->Get( vtkDataObject::SPACING() ) );
+    this->Reslice->SetOutputOrigin( outInfo->Get( vtkDataObject::ORIGIN() ) );
+    if ( vtkImageCompressedReslice* compressed = vtkImageCompressedReslice::SafeDownCast( reslice ) )
+    {
+        // The voxels are in the compressed volume (whose brick cache is shared), not the input
+        static_cast< vtkImageCompressedReslice* >( this->Reslice.GetPointer() )->SetCompressedVolume( compressed->GetCompressedVolume() );
+    }
+
+    vtkAlgorithm* last = this->Reslice;
+    if ( slabProjection )
+    {
+        this->SlabProjection = vtkSmartPointer<vtkImageSlabProjection>::New();
+        this->SlabProjection->SetMode( slabProjection->GetMode() );
+        this->SlabProjection->SetInputConnection( this->Reslice->GetOutputPort() );
+        last = this->SlabProjection;
+    }
+
+    // The lookup table isn't safe to share once the other thread starts building it
+    vtkSmartPointer<vtkScalarsToColors> table;
+    table.TakeReference( colors->GetLookupTable()->NewInstance() );
+    table->DeepCopy( colors->GetLookupTable() );
+
+    this->Colors = vtkSmartPointer<vtkImageMapToColors>::New();
+    this->Colors->SetLookupTable( table );
+    this->Colors->SetOutputFormat( colors->GetOutputFormat() );
+    this->Colors->SetInputConnection( last->GetOutputPort() );
+}
+
+bool SliceRenderer::Matches( vtkImageReslice* reslice, vtkImageSlabProjection* slabProjection, vtkImageMapToColors* colors ) const
+{
+    return DescribePipeline( reslice, slabProjection, colors ) == this->Description;
+}
+
+std::vector< long long > SliceRenderer::DescribePipeline( vtkImageReslice* reslice, vtkImageSlabProjection* slabProjection, vtkImageMapToColors* colors )
+{
+    std::vector< long long > description;
+    
+    // The volume, by object and modified time (so new voxels count as a different volume)
+    vtkDataObject* volume = reslice->GetInput();
+    description.push_back( static_cast< long long >( reinterpret_cast< std::intptr_t >( volume ) ) );
+    description.push_back( volume ? static_cast< long long >( volume->GetMTime() ) : 0 );
+    vtkImageCompressedReslice* compressed = vtkImageCompressedReslice::SafeDownCast( reslice );
+    description.push_back( static_cast< long long >( reinterpret_cast< std::intptr_t >( compressed ? compressed->GetCompressedVolume() : 0 ) ) );
+    
+    // Output geometry (the slab thickness is in the extent) and sampling
+    vtkInformation* outInfo = reslice->GetOutputInformation( 0 );
+    int extent[6];
+    outInfo->Get( vtkStreamingDemandDrivenPipeline::WHOLE_EXTENT(), extent );
+    description.insert( description.end(), extent, extent + 6 );
+    const double* spacing = outInfo->Get( vtkDataObject::SPACING() );
+    const double* origin = outInfo->Get( vtkDataObject::ORIGIN() );
+    for ( int i = 0; i < 3; ++i )
+    {
+        description.push_back( std::llround( spacing[i] * 1000.0 ) );
+        description.push_back( std::llround( origin[i] * 1000.0 ) );
+    }
+    description.push_back( reslice->GetOutputDimensionality() );
+    description.push_back( reslice->GetInterpolationMode() );
+    description.push_back( std::llround( reslice->GetBackgroundLevel() * 1000.0 ) );
+    description.push_back( slabProjection ? slabProjection->GetMode() : -1 );
+    
+    // Colouring, by table and modified time (window/level changes the table)
+    vtkScalarsToColors* table = colors->GetLookupTable();
+    description.push_back( static_cast< long long >( reinterpret_cast< std::intptr_t >( table ) ) );
+    description.push_back( static_cast< long long >( table->GetMTime() ) );
+    description.push_back( colors->GetOutputFormat() );
+    return description;
+}
+
+vtkSmartPointer<vtkImageData> SliceRenderer::Render( const double axes[16] )
+{
+    this->Axes->DeepCopy( axes );
+    this->Colors->Update();
+
+    vtkSmartPointer<vtkImageData> slice = vtkSmartPointer<vtkImageData>::New();
+    slice->DeepCopy( this->Colors->GetOutput() );
+    return slice;
+}
@@ -0,0 +1,60 @@
+//
+//  SliceRenderer.h
+//  ImageSlicing
+//
+//  Created by Tom on 12/09/2016.
+//
+//
+
+#ifndef SliceRenderer_h
+#define SliceRenderer_h
+
+#include "vtkSmartPointer.h"
+#include "vtkImageData.h"
+
+#include <vector>
+
+class vtkImageMapToColors;
+class vtkImageReslice;
+class vtkImageSlabProjection;
+class vtkMatrix4x4;
+
+/**
+ * A private copy of the on-screen reslice -> (slab projection) -> colours pipeline, for making the same
+ * finished slices on another thread. It has to be made on the thread that owns the original pipeline (which
+ * must have been updated at least once), and after that belongs to whichever one thread calls Render. The
+ * output geometry is what the original worked out, which stays right while the axes only move along the normal.
+ */
+class SliceRenderer
+{
+public:
+
+    SliceRenderer( vtkImageReslice* reslice, vtkImageSlabProjection* slabProjection, vtkImageMapToColors* colors );
+
+    // A new image each time (nothing else holds on to it)
+    vtkSmartPointer<vtkImageData> Render( const double axes[16] );
+
+    // Output spacing along the normal, i.e. one slice
+    double GetSliceSpacing() const { return this->SliceSpacing; }
+
+    // Whether this copy still makes the same slices as the pipeline would now: same volume, lookup table,
+    // slab and output geometry. Only the axes are allowed to have moved. Safe while another thread renders.
+    bool Matches( vtkImageReslice* reslice, vtkImageSlabProjection* slabProjection, vtkImageMapToColors* colors ) const;
+
+private:
+
+    SliceRenderer( const SliceRenderer& );
+    void operator=( const SliceRenderer& );
+
+    // Everything Matches compares, rounded as for SliceCache::Key
+    static std::vector< long long > DescribePipeline( vtkImageReslice* reslice, vtkImageSlabProjection* slabProjection, vtkImageMapToColors* colors );
+
+    vtkSmartPointer<vtkMatrix4x4> Axes;
+    vtkSmartPointer<vtkImageReslice> Reslice;
+    vtkSmartPointer<vtkImageSlabProjection> SlabProjection;
+    vtkSmartPointer<vtkImageMapToColors> Colors;
+    double SliceSpacing;
+    std::vector< long long > Description;
+};
+
+#endif /* SliceRenderer_h */
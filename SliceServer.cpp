@@ -0,0 +1,540 @@
+//
+//  SliceServer.cpp
+//  ImageSlicing
+//
+//  Created by Tom on 29/08/2016.
+//
+//
+
+#include "SliceServer.h"
+
+#include "itkImage.h"
+#include "itkGDCMSeriesFileNames.h"
+
+#include "vtkMatrix4x4.h"
+#include "vtkImageReslice.h"
+#include "vtkImageMapToWindowLevelColors.h"
+#include "vtkPNGWriter.h"
+#include "vtkUnsignedCharArray.h"
+
+#include "PipelinedSeriesLoader.h"
+#include "SharedVolume.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace
+{
+    typedef itk::Image< signed short, 3 > ImageType;
+    typedef std::chrono::steady_clock Clock;
+
+    double Milliseconds( Clock::time_point start, Clock::time_point end )
+    {
+        return std::chrono::duration< double, std::milli >( end - start ).count();
+    }
+
+    bool SendAll( int connection, const char* data, std::size_t length )
+    {
+        while ( length > 0 )
+        {
+            const ssize_t sent = send( connection, data, length, 0 );
+            if ( sent < 0 )
+            {
+                if ( errno == EINTR )
+                {
+                    continue;
+                }
+                return false;
+            }
+            data += sent;
+            length -= sent;
+        }
+        return true;
+    }
+
+    // Keep the reply to one line whatever the message
+    std::string ErrorReply( std::string message )
+    {
+        std::replace( message.begin(), message.end(), '\n', ' ' );
+        return "ERROR " + message + "\n";
+    }
+
+    // The server whose Run() is going, for the signal handler
+    std::atomic< bool >* SignalStopping = nullptr;
+    volatile std::sig_atomic_t SignalListenSocket = -1;
+
+    // Only async-signal-safe calls here: flag the stop and wake accept(), and Run() does the rest of Stop()
+    void HandleStopSignal( int )
+    {
+        if ( SignalStopping )
+        {
+            *SignalStopping = true;
+        }
+        if ( SignalListenSocket >= 0 )
+        {
+            shutdown( SignalListenSocket, SHUT_RDWR );
+        }
+    }
+}
+
+SliceServer::SliceServer()
+: SocketPath( "/tmp/ImageSlicing.sock" ), ListenSocket( -1 ), Stopping( false ),
+  CachedBytes( 0 ), MaximumCacheBytes( std::size_t( 4 ) << 30 ), ActiveConnections( 0 )
+{
+}
+
+SliceServer::~SliceServer()
+{
+    this->Stop();
+}
+
+void SliceServer::SetLatencyLogFileName( const std::string& fileName )
+{
+    std::lock_guard< std::mutex > lock( this->LogMutex );
+    this->LogFile.close();
+    this->LogFile.open( fileName.c_str(), std::ios::app );
+}
+
+int SliceServer::Run()
+{
+    sockaddr_un address;
+    std::memset( &address, 0, sizeof( address ) );
+    address.sun_family = AF_UNIX;
+    if ( this->SocketPath.size() >= sizeof( address.sun_path ) )
+    {
+        std::cerr << "Socket path too long: " << this->SocketPath << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::strncpy( address.sun_path, this->SocketPath.c_str(), sizeof( address.sun_path ) - 1 );
+
+    // A client hanging up mid-reply should just end that connection
+    std::signal( SIGPIPE, SIG_IGN );
+
+    // Nobody else gets to connect: the socket is created 0600
+    const int listenSocket = socket( AF_UNIX, SOCK_STREAM, 0 );
+    unlink( this->SocketPath.c_str() );
+    const mode_t previousMask = umask( S_IRWXG | S_IRWXO | S_IXUSR );
+    const bool bound = listenSocket >= 0 && bind( listenSocket, reinterpret_cast< sockaddr* >( &address ), sizeof( address ) ) == 0;
+    umask( previousMask );
+    if ( !bound || listen( listenSocket, 16 ) != 0 )
+    {
+        std::cerr << "Couldn't listen on " << this->SocketPath << ": " << std::strerror( errno ) << std::endl;
+        if ( listenSocket >= 0 )
+        {
+            close( listenSocket );
+        }
+        return EXIT_FAILURE;
+    }
+    {
+        std::lock_guard< std::mutex > lock( this->ConnectionsMutex );
+        this->ListenSocket = listenSocket;
+    }
+
+    // Ctrl-C or a service manager's SIGTERM stops us the same way as Stop(). No SA_RESTART, so a blocked
+    // accept() or recv() comes back with EINTR and sees the flag.
+    SignalStopping = &this->Stopping;
+    SignalListenSocket = listenSocket;
+    struct sigaction stopAction, previousInterrupt, previousTerminate;
+    std::memset( &stopAction, 0, sizeof( stopAction ) );
+    stopAction.sa_handler = HandleStopSignal;
+    sigemptyset( &stopAction.sa_mask );
+    sigaction( SIGINT, &stopAction, &previousInterrupt );
+    sigaction( SIGTERM, &stopAction, &previousTerminate );
+
+    std::cout << "Serving slices on " << this->SocketPath << std::endl;
+
+    while ( !this->Stopping )
+    {
+        const int connection = accept( listenSocket, nullptr, nullptr );
+        if ( connection < 0 )
+        {
+            if ( errno == EINTR || errno == ECONNABORTED )
+            {
+                continue;
+            }
+            break;
+        }
+
+        {
+            // Stop() sets the flag before it hangs up on everything in Connections, so either it sees this one
+            // or we see the flag
+            std::lock_guard< std::mutex > lock( this->ConnectionsMutex );
+            if ( this->Stopping )
+            {
+                close( connection );
+                break;
+            }
+            this->Connections.insert( connection );
+            ++this->ActiveConnections;
+        }
+        std::thread( [this, connection]()
+        {
+            this->ServeConnection( connection );
+
+            // Out of the set before it's closed, so Stop() can't shut down a reused descriptor
+            std::lock_guard< std::mutex > lock( this->ConnectionsMutex );
+            this->Connections.erase( connection );
+            close( connection );
+            --this->ActiveConnections;
+            this->ConnectionsFinished.notify_all();
+        } ).detach();
+    }
+
+    // Stopped by a signal, or accept() failed: hang up on the connections too
+    this->Stop();
+
+    sigaction( SIGINT, &previousInterrupt, nullptr );
+    sigaction( SIGTERM, &previousTerminate, nullptr );
+    SignalListenSocket = -1;
+    SignalStopping = nullptr;
+
+    // Let the connections that are still going finish before anything they use goes away
+    std::unique_lock< std::mutex > lock( this->ConnectionsMutex );
+    this->ConnectionsFinished.wait( lock, [this]() { return this->ActiveConnections == 0; } );
+    close( this->ListenSocket );
+    this->ListenSocket = -1;
+    unlink( this->SocketPath.c_str() );
+    std::cout << "Stopped serving slices" << std::endl;
+    return EXIT_SUCCESS;
+}
+
+void SliceServer::Stop()
+{
+    this->Stopping = true;
+
+    // Wakes up accept(), and every connection thread blocked in recv(), which then sees end of file
+    std::lock_guard< std::mutex > lock( this->ConnectionsMutex );
+    if ( this->ListenSocket >= 0 )
+    {
+        shutdown( this->ListenSocket, SHUT_RDWR );
+    }
+    for ( std::set< int >::const_iterator connection = this->Connections.begin(); connection != this->Connections.end(); ++connection )
+    {
+        shutdown( *connection, SHUT_RDWR );
+    }
+}
+
+void SliceServer::ServeConnection( int connection )
+{
+    std::string pending;
+    char buffer[4096];
+    while ( !this->Stopping )
+    {
+        const ssize_t received = recv( connection, buffer, sizeof( buffer ), 0 );
+        if ( received < 0 && errno == EINTR )
+        {
+            continue;
+        }
+        if ( received <= 0 )
+        {
+            return;
+        }
+        pending.append( buffer, received );
+
+        std::string::size_type newline;
+        while ( ( newline = pending.find( '\n' ) ) != std::string::npos )
+        {
+            const std::string reply = this->HandleRequest( pending.substr( 0, newline ) );
+            pending.erase( 0, newline + 1 );
+            if ( !SendAll( connection, reply.data(), reply.size() ) )
+            {
+                return;
+            }
+        }
+    }
+}
+
+std::string SliceServer::HandleRequest( const std::string& line )
+{
+    const Clock::time_point start = Clock::now();
+
+    SliceRequest request;
+    if ( !ParseRequest( line, request ) )
+    {
+        this->LogLatency( "", false, 0, 0, Milliseconds( start, Clock::now() ), 0, "bad request" );
+        return ErrorReply( "bad request" );
+    }
+
+    bool cacheHit = false;
+    double loadMs = 0;
+    try
+    {
+        vtkSmartPointer<vtkImageData> volume = this->GetVolume( request.Directory, request.SeriesIdentifier, cacheHit );
+        const Clock::time_point loaded = Clock::now();
+        loadMs = Milliseconds( start, loaded );
+
+        std::string png;
+        int width = 0, height = 0;
+        RenderSlice( volume, request, png, width, height );
+        const Clock::time_point rendered = Clock::now();
+
+        std::ostringstream reply;
+        reply << "OK " << width << " " << height << " " << png.size() << "\n";
+        std::string result = reply.str();
+        result += png;
+
+        this->LogLatency( request.SeriesIdentifier.empty() ? request.Directory : request.SeriesIdentifier, cacheHit,
+                          loadMs, Milliseconds( loaded, rendered ), Milliseconds( start, rendered ), png.size(), "" );
+        return result;
+    }
+    catch ( itk::ExceptionObject& ex )
+    {
+        this->LogLatency( request.Directory, cacheHit, loadMs, 0, Milliseconds( start, Clock::now() ), 0, ex.GetDescription() );
+        return ErrorReply( ex.GetDescription() );
+    }
+    catch ( std::exception& ex )
+    {
+        this->LogLatency( request.Directory, cacheHit, loadMs, 0, Milliseconds( start, Clock::now() ), 0, ex.what() );
+        return ErrorReply( ex.what() );
+    }
+}
+
+bool SliceServer::ParseRequest( const std::string& line, SliceRequest& request )
+{
+    std::vector< std::string > fields;
+    std::stringstream stream( line );
+    std::string field;
+    while ( std::getline( stream, field, '\t' ) )
+    {
+        fields.push_back( field );
+    }
+    if ( fields.size() != 7 || fields[0] != "SLICE" || fields[1].empty() )
+    {
+        return false;
+    }
+
+    request.Directory = fields[1];
+    request.SeriesIdentifier = fields[2];
+
+    std::istringstream axes( fields[3] );
+    for ( int i = 0; i < 9; ++i )
+    {
+        axes >> request.Axes[i];
+    }
+    std::istringstream position( fields[4] );
+    for ( int i = 0; i < 3; ++i )
+    {
+        position >> request.Position[i];
+    }
+    std::istringstream window( fields[5] );
+    window >> request.Window;
+    std::istringstream level( fields[6] );
+    level >> request.Level;
+
+    return !axes.fail() && !position.fail() && !window.fail() && !level.fail() && request.Window > 0;
+}
+
+vtkSmartPointer<vtkImageData> SliceServer::LoadSeries( const std::string& directory, const std::string& seriesIdentifier,
+                                                      IntensityHistogram* histogram )
+{
+    // Same series selection as TgwSlicer
+    typedef itk::GDCMSeriesFileNames NamesGeneratorType;
+    NamesGeneratorType::Pointer nameGenerator = NamesGeneratorType::New();
+    nameGenerator->SetUseSeriesDetails( true );
+    nameGenerator->AddSeriesRestriction( "0008|0021" );
+    nameGenerator->SetDirectory( directory );
+
+    std::string series = seriesIdentifier;
+    if ( series.empty() )
+    {
+        const std::vector< std::string >& seriesUID = nameGenerator->GetSeriesUIDs();
+        if ( seriesUID.empty() )
+        {
+            itkGenericExceptionMacro( << "No DICOM series in " << directory );
+        }
+        series = seriesUID.front();
+    }
+
+    // A viewer may have published it already. PipelinedSeriesLoader crops the same as the viewer's default
+    // pipeline, so that's the one to look for.
+    vtkSmartPointer<vtkImageData> shared = SharedVolume::Map( SharedVolume::GetNameForSeries( series, "cropped" ) );
+    if ( shared )
+    {
+        return shared;
+    }
+
+    const std::vector< std::string > fileNames = nameGenerator->GetFileNames( series );
+    if ( fileNames.size() < 3 )
+    {
+        itkGenericExceptionMacro( << "Series " << series << " in " << directory << " has too few slices" );
+    }
+
+    PipelinedSeriesLoader< ImageType > loader;
+    loader.SetFileNames( fileNames );
+    vtkSmartPointer<vtkImageData> volume = loader.Load();
+    if ( histogram )
+    {
+        *histogram = loader.GetHistogram();
+    }
+    return volume;
+}
+
+vtkSmartPointer<vtkImageData> SliceServer::GetVolume( const std::string& directory, const std::string& seriesIdentifier, bool& cacheHit )
+{
+    const std::string key = directory + "\t" + seriesIdentifier;
+
+    std::shared_future< vtkSmartPointer<vtkImageData> > volume;
+    std::promise< vtkSmartPointer<vtkImageData> > promise;
+    bool loadHere = false;
+    {
+        std::lock_guard< std::mutex > lock( this->CacheMutex );
+        std::map< std::string, CacheEntry >::iterator it = this->Cache.find( key );
+        if ( it != this->Cache.end() )
+        {
+            volume = it->second.Volume;
+            cacheHit = volume.wait_for( std::chrono::seconds( 0 ) ) == std::future_status::ready;
+            this->LruOrder.splice( this->LruOrder.begin(), this->LruOrder, it->second.LruPosition );
+        }
+        else
+        {
+            cacheHit = false;
+            loadHere = true;
+            this->LruOrder.push_front( key );
+            CacheEntry& entry = this->Cache[key];
+            entry.Volume = promise.get_future().share();
+            entry.Bytes = 0;
+            entry.LruPosition = this->LruOrder.begin();
+            volume = entry.Volume;
+        }
+    }
+
+    if ( loadHere )
+    {
+        try
+        {
+            vtkSmartPointer<vtkImageData> loaded = LoadSeries( directory, seriesIdentifier );
+
+            std::lock_guard< std::mutex > lock( this->CacheMutex );
+            promise.set_value( loaded );
+            std::map< std::string, CacheEntry >::iterator it = this->Cache.find( key );
+            if ( it != this->Cache.end() )
+            {
+                it->second.Bytes = static_cast< std::size_t >( loaded->GetActualMemorySize() ) * 1024;
+                this->CachedBytes += it->second.Bytes;
+                this->EvictLocked( key );
+            }
+        }
+        catch ( ... )
+        {
+            // Don't cache failures, the next request can have another go
+            std::lock_guard< std::mutex > lock( this->CacheMutex );
+            promise.set_exception( std::current_exception() );
+            std::map< std::string, CacheEntry >::iterator it = this->Cache.find( key );
+            if ( it != this->Cache.end() )
+            {
+                this->LruOrder.erase( it->second.LruPosition );
+                this->Cache.erase( it );
+            }
+        }
+    }
+
+    // Throws whatever the load threw
+    volume.wait();
+    std::lock_guard< std::mutex > lock( this->CacheMutex );
+    const vtkSmartPointer<vtkImageData>& shared = volume.get();
+
+    // A separate data object per request, sharing the scalars, so the requests' pipelines don't trip over each
+    // other and an eviction doesn't pull the volume out from under us
+    vtkSmartPointer<vtkImageData> copy = vtkSmartPointer<vtkImageData>::New();
+    copy->ShallowCopy( shared );
+    return copy;
+}
+
+void SliceServer::EvictLocked( const std::string& keep )
+{
+    std::list< std::string >::iterator it = this->LruOrder.end();
+    while ( this->CachedBytes > this->MaximumCacheBytes && it != this->LruOrder.begin() )
+    {
+        --it;
+        std::map< std::string, CacheEntry >::iterator entry = this->Cache.find( *it );
+        // Still loading (no size yet) or the one we've just loaded
+        if ( *it == keep || entry->second.Bytes == 0 )
+        {
+            continue;
+        }
+        std::cout << "Evicting " << *it << " (" << ( entry->second.Bytes >> 20 ) << " MB)" << std::endl;
+        this->CachedBytes -= entry->second.Bytes;
+        this->Cache.erase( entry );
+        it = this->LruOrder.erase( it );
+    }
+}
+
+void SliceServer::RenderSlice( vtkImageData* volume, const SliceRequest& request, std::string& png, int& width, int& height )
+{
+    vtkSmartPointer<vtkMatrix4x4> resliceAxes = vtkSmartPointer<vtkMatrix4x4>::New();
+    for ( int i = 0; i < 3; ++i )
+    {
+        for ( int j = 0; j < 3; ++j )
+        {
+            resliceAxes->SetElement( i, j, request.Axes[3 * i + j] );
+        }
+        resliceAxes->SetElement( i, 3, request.Position[i] );
+    }
+
+    vtkSmartPointer<vtkImageReslice> reslice = vtkSmartPointer<vtkImageReslice>::New();
+    reslice->SetInputData( volume );
+    reslice->SetOutputDimensionality( 2 );
+    reslice->SetResliceAxes( resliceAxes );
+    reslice->SetInterpolationModeToLinear();
+
+    vtkSmartPointer<vtkImageMapToWindowLevelColors> windowLevel = vtkSmartPointer<vtkImageMapToWindowLevelColors>::New();
+    windowLevel->SetInputConnection( reslice->GetOutputPort() );
+    windowLevel->SetWindow( request.Window );
+    windowLevel->SetLevel( request.Level );
+    windowLevel->SetOutputFormatToLuminance();
+
+    vtkSmartPointer<vtkPNGWriter> writer = vtkSmartPointer<vtkPNGWriter>::New();
+    writer->SetInputConnection( windowLevel->GetOutputPort() );
+    writer->WriteToMemoryOn();
+    writer->Write();
+
+    int dimensions[3];
+    windowLevel->GetOutput()->GetDimensions( dimensions );
+    width = dimensions[0];
+    height = dimensions[1];
+
+    vtkUnsignedCharArray* result = writer->GetResult();
+    png.assign( reinterpret_cast< const char* >( result->GetPointer( 0 ) ),
+                static_cast< std::size_t >( result->GetNumberOfTuples() * result->GetNumberOfComponents() ) );
+}
+
+void SliceServer::LogLatency( const std::string& series, bool cacheHit, double loadMs, double renderMs, double totalMs, std::size_t bytes, const std::string& error )
+{
+    char timestamp[32];
+    const std::time_t now = std::time( nullptr );
+    std::tm local;
+    localtime_r( &now, &local );
+    std::strftime( timestamp, sizeof( timestamp ), "%Y-%m-%dT%H:%M:%S", &local );
+
+    std::ostringstream line;
+    line << timestamp << "\t" << series << "\t" << ( cacheHit ? "hit" : "miss" )
+         << "\tload " << loadMs << " ms\trender " << renderMs << " ms\ttotal " << totalMs << " ms\t" << bytes << " bytes";
+    if ( !error.empty() )
+    {
+        line << "\terror: " << error;
+    }
+
+    std::lock_guard< std::mutex > lock( this->LogMutex );
+    if ( this->LogFile.is_open() )
+    {
+        this->LogFile << line.str() << std::endl;
+    }
+    else
+    {
+        std::cout << line.str() << std::endl;
+    }
+}
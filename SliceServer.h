@@ -0,0 +1,132 @@
+//
+//  SliceServer.h
+//  ImageSlicing
+//
+//  Created by Tom on 29/08/2016.
+//
+//
+
+#ifndef SliceServer_h
+#define SliceServer_h
+
+#include "vtkSmartPointer.h"
+#include "vtkImageData.h"
+
+class IntensityHistogram;
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <fstream>
+#include <future>
+#include <list>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+
+/**
+ * Headless mode for the web viewer: keeps decoded and box-car filtered volumes in memory (least recently used
+ * ones are dropped once they add up to more than SetMaximumCacheBytes) and serves PNG slices of them over a
+ * local Unix-domain socket. Each connection gets its own thread and can send any number of requests, one per
+ * line, with the fields separated by tabs:
+ *
+ *     SLICE <directory> <series UID, or empty for the first> <9 axes> <x y z> <window> <level>
+ *
+ * where the axes are the 3x3 direction part of the reslice matrix, row by row (the columns are the slice's x
+ * and y directions and its normal, as for vtkImageReslice::SetResliceAxes), and x y z is the slice centre in
+ * world coordinates. The reply is "OK <width> <height> <bytes>\n" followed by that many bytes of PNG, or
+ * "ERROR <message>\n".
+ *
+ * Volumes already published with SharedVolume are mapped rather than loaded again.
+ *
+ * Every request gets a line in the latency log (standard output unless SetLatencyLogFileName is used).
+ *
+ * The socket is only accessible to the user running the server (0600). SIGINT and SIGTERM stop the server
+ * cleanly while Run() is going.
+ */
+class SliceServer
+{
+public:
+
+    struct SliceRequest
+    {
+        std::string Directory;
+        std::string SeriesIdentifier;
+        double Axes[9];
+        double Position[3];
+        double Window;
+        double Level;
+    };
+
+    SliceServer();
+    ~SliceServer();
+
+    void SetSocketPath( const std::string& path ) { this->SocketPath = path; }
+    void SetMaximumCacheBytes( std::size_t bytes ) { this->MaximumCacheBytes = bytes; }
+    void SetLatencyLogFileName( const std::string& fileName );
+
+    // Listen and serve until Stop() is called (from another thread) or the process gets SIGINT or SIGTERM.
+    // Returns EXIT_FAILURE if the socket couldn't be set up.
+    int Run();
+    
+    // Stop accepting and hang up on the open connections, so that Run() returns. Can be called any number
+    // of times.
+    void Stop();
+
+    // Parse one request line (without the newline)
+    static bool ParseRequest( const std::string& line, SliceRequest& request );
+
+    // Our own shallow copy of the volume for the series, loading it first unless it's resident. Concurrent
+    // requests for a series that is still loading wait for that load rather than starting another.
+    vtkSmartPointer<vtkImageData> GetVolume( const std::string& directory, const std::string& seriesIdentifier, bool& cacheHit );
+
+    // Reslice, window/level and PNG encode
+    static void RenderSlice( vtkImageData* volume, const SliceRequest& request, std::string& png, int& width, int& height );
+
+    // Find the series in the directory, then read and filter it with PipelinedSeriesLoader. If histogram is
+    // given it gets the loader's histogram, or is left empty when the volume was already in shared memory.
+    static vtkSmartPointer<vtkImageData> LoadSeries( const std::string& directory, const std::string& seriesIdentifier,
+                                                     IntensityHistogram* histogram = nullptr );
+
+private:
+
+    SliceServer( const SliceServer& );
+    void operator=( const SliceServer& );
+
+    struct CacheEntry
+    {
+        std::shared_future< vtkSmartPointer<vtkImageData> > Volume;
+        std::size_t Bytes;
+        std::list< std::string >::iterator LruPosition;
+    };
+
+    void ServeConnection( int connection );
+    std::string HandleRequest( const std::string& line );
+
+    // Drop least recently used volumes until we're under the limit, never dropping keep. Cache lock held.
+    void EvictLocked( const std::string& keep );
+
+    void LogLatency( const std::string& series, bool cacheHit, double loadMs, double renderMs, double totalMs, std::size_t bytes, const std::string& error );
+
+    std::string SocketPath;
+    int ListenSocket;
+    std::atomic<bool> Stopping;
+
+    std::mutex CacheMutex;
+    std::map< std::string, CacheEntry > Cache;
+    std::list< std::string > LruOrder;
+    std::size_t CachedBytes;
+    std::size_t MaximumCacheBytes;
+
+    // The connection sockets still open, so that Stop() can wake the threads blocked reading them
+    std::mutex ConnectionsMutex;
+    std::condition_variable ConnectionsFinished;
+    std::set< int > Connections;
+    int ActiveConnections;
+
+    std::mutex LogMutex;
+    std::ofstream LogFile;
+};
+
+#endif /* SliceServer_h */
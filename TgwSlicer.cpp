@@ -49,6 +49,90 @@
 #include "itkCropImageFilter.h"
 #include "itkImageToVTKImageFilter.h"
 
+#include <algorithm>
+#include <cstdlib>
+#include <exception>
+
+// Only open the DICOM files that the downstream filters actually need (optionally a slab of slices given on
+// the command line), rather than decoding the whole series up front
+#define USE_SLAB_LIMITED_READER 0
+
+// Overlap the DICOM decode, box-car filtering and conversion to VTK instead of running them one after another
+#define USE_PIPELINED_LOADING 0
+
+// Run the box-car filter as fine-grained tasks on a work-stealing thread pool
+#define USE_WORK_STEALING_FILTER 0
+
+// On multi-socket machines, decode and filter in Z slabs on threads pinned to the node that owns each slab's
+// memory (the reader part needs USE_SLAB_LIMITED_READER)
+#define USE_NUMA_PLACEMENT 0
+
+// Don't bother filtering the bricks of air outside the patient, just fill them in
+#define USE_EMPTY_BRICK_SKIPPING 0
+
+// Keep peak memory down to about one volume: filter in place on top of the reader's buffer (with a rolling
+// copy of two slices), drop the reader's hold on it, and hand the result to VTK without cropping (i.e. copying)
+// it. This always works on the whole series.
+#define USE_LOW_MEMORY_PIPELINE 0
+
+// Recycle the volume and slice buffers through VolumeBufferPool instead of freeing and reallocating them on
+// every update and every frame
+#define USE_BUFFER_POOL 0
+
+// Look for the volume in shared memory first (published by another viewer that is still open), and if it isn't
+// there load it as usual and publish it for the next viewer, until this one exits. See SharedVolume.
+#define USE_SHARED_VOLUME 0
+
+// Keep watching the DICOM directory while the viewer is up, and add slices to the displayed volume as the
+// scanner writes them (decoding and filtering only what's new). See IncrementalSeriesVolume.
+#define USE_DIRECTORY_WATCH 0
+#if USE_DIRECTORY_WATCH && USE_SHARED_VOLUME
+#error "The shared volume can't follow the series as it grows, use one or the other"
+#endif
+
+// Show a thick-slab maximum intensity projection SLAB_THICKNESS (mm) thick instead of a single slice
+#define USE_THICK_SLAB 0
+#define SLAB_THICKNESS 10.0
+
+// Slice along the oblique axes below instead of axially
+#define USE_OBLIQUE_VIEW 0
+
+// Reslice with the fixed point integer path for signed short volumes (see vtkImageFixedPointReslice)
+#define USE_FIXED_POINT_RESLICE 0
+
+// Keep the last few finished slices and make the next ones in the scroll direction in the background, so
+// scrolling back and forth doesn't reslice at all (see SliceCache)
+#define USE_SLICE_CACHE 0
+
+// Press 'c' to play through the volume at CINE_FRAME_RATE slices a second ('+' and '-' to change it), along
+// the normal of whatever is being viewed (see CinePlayer)
+#define USE_CINE 0
+#define CINE_FRAME_RATE 30.0
+
+// Set the initial window/level from a histogram of the filtered volume, worked out while it is being filtered,
+// instead of the fixed 0-1000 (which only really suits some CT)
+#define USE_AUTO_WINDOW_LEVEL 0
+
+// Let BoxCarAutotuner pick the filter strategy and thread count for this machine (calibrating on the first run
+// and caching the answer), instead of USE_WORK_STEALING_FILTER / USE_NUMA_PLACEMENT
+#define USE_AUTOTUNED_FILTER 0
+
+// Treat the series as 4D (one volume per time point) and keep only a few filtered time points in memory.
+// Right/Left step through time at the same slice, 't' plays at TIME_FRAME_RATE volumes a second. See
+// TimeSeriesVolume.
+#define USE_TIME_SERIES 0
+#define TIME_FRAME_RATE 5.0
+#if USE_TIME_SERIES && ( USE_DIRECTORY_WATCH || USE_SHARED_VOLUME )
+#error "The time series swaps volumes under the viewer, it can't be shared or grown as well"
+#endif
+
+// Keep the filtered volume losslessly compressed in memory (2-3x smaller for CT) instead of as it is, and
+// reslice it a brick at a time through a cache of decoded bricks. See CompressedBrickVolume.
+#define USE_COMPRESSED_VOLUME 0
+#if USE_COMPRESSED_VOLUME && ( USE_DIRECTORY_WATCH || USE_TIME_SERIES || USE_SHARED_VOLUME )
+#error "The compressed volume is a snapshot of one loaded volume, it can't follow a growing series or time points, or be shared"
+#endif
+
 #define USE_BASIC_IMAGE_VIEWER_APPROACH 0
 #if USE_BASIC_IMAGE_VIEWER_APPROACH
 
@@ -75,23 +159,83 @@
 #include "vtkRenderWindowInteractor.h"
 #include "vtkInteractorStyleImage.h"
 #include "vtkCommand.h"
+#include "vtkCallbackCommand.h"
 #include "vtkImageData.h"
 #include "vtkImageViewer.h"
 
 #include "vtkImageInteractionCallback.hpp"
+#include "vtkPooledImageFilters.hpp"
+#include "vtkImageSlabProjection.hpp"
+#include "vtkImageFixedPointReslice.hpp"
+#include "vtkImageCompressedReslice.hpp"
 
 #endif
 
+#include "BoxCarAutotuner.h"
 #include "BoxCarSmoothFilter.h"
+#include "CinePlayer.h"
+#include "CompressedBrickVolume.h"
+#include "DicomSlabSeriesReader.h"
+#include "IncrementalSeriesVolume.h"
+#include "IntensityHistogram.h"
+#include "PipelinedSeriesLoader.h"
+#include "SeriesDirectoryWatcher.h"
+#include "SharedVolume.h"
+#include "SliceCache.h"
+#include "SliceExporter.h"
+#include "SliceServer.h"
+#include "TimeSeriesVolume.h"
 
 // Software Guide : EndCodeSnippet
 int main( int argc, char* argv[] )
 {
+    // Headless: keep volumes resident and serve slices to the web viewer, see SliceServer
+    if( argc > 2 && std::string( argv[1] ) == "--serve" )
+    {
+        SliceServer server;
+        server.SetSocketPath( argv[2] );
+        if( argc > 3 )
+        {
+            server.SetMaximumCacheBytes( static_cast< std::size_t >( std::strtoull( argv[3], nullptr, 10 ) ) << 20 );
+        }
+        if( argc > 4 )
+        {
+            server.SetLatencyLogFileName( argv[4] );
+        }
+        return server.Run();
+    }
+
+    // Headless: write preview PNGs (or one montage) of the first series, see SliceExporter
+    if( argc > 3 && std::string( argv[1] ) == "--export" )
+    {
+        SliceExporter exporter;
+        exporter.SetDirectory( argv[2] );
+        exporter.SetOutputPrefix( argv[3] );
+        if( argc > 4 )
+        {
+            exporter.SetNumberOfSlices( static_cast< unsigned int >( std::strtoul( argv[4], nullptr, 10 ) ) );
+        }
+        if( argc > 5 )
+        {
+            exporter.SetMontage( std::string( argv[5] ) == "montage" );
+        }
+        return exporter.Run();
+    }
+
     if( argc < 2 )
     {
         std::cerr << "Usage: " << std::endl;
+#if USE_SLAB_LIMITED_READER
+        std::cerr << argv[0] << " DicomDirectory [seriesName [firstSlice lastSlice]]"
+        << std::endl;
+#else
         std::cerr << argv[0] << " DicomDirectory [seriesName]"
         << std::endl;
+#endif
+        std::cerr << argv[0] << " --serve SocketPath [cacheMegabytes [latencyLogFile]]"
+        << std::endl;
+        std::cerr << argv[0] << " --export DicomDirectory OutputPrefix [slicesPerOrientation [montage]]"
+        << std::endl;
         return EXIT_FAILURE;
     }
     // Software Guide : BeginLatex
@@ -117,7 +261,11 @@ int main( int argc, char* argv[] )
     //
     // Software Guide : EndLatex
     // Software Guide : BeginCodeSnippet
+#if USE_SLAB_LIMITED_READER
+    typedef DicomSlabSeriesReader< ImageType >         ReaderType;
+#else
     typedef itk::ImageSeriesReader< ImageType >        ReaderType;
+#endif
     ReaderType::Pointer reader = ReaderType::New();
     // Software Guide : EndCodeSnippet
     // Software Guide : BeginLatex
@@ -129,7 +277,16 @@ int main( int argc, char* argv[] )
     // Software Guide : BeginCodeSnippet
     typedef itk::GDCMImageIO       ImageIOType;
     ImageIOType::Pointer dicomIO = ImageIOType::New();
+#if !USE_SLAB_LIMITED_READER
     reader->SetImageIO( dicomIO );
+#else
+#if USE_NUMA_PLACEMENT
+    reader->UseNumaPlacementOn();
+#endif
+#if USE_BUFFER_POOL
+    reader->UseBufferPoolOn();
+#endif
+#endif
     // Software Guide : EndCodeSnippet
     // Software Guide : BeginLatex
     //
@@ -171,6 +328,11 @@ int main( int argc, char* argv[] )
     // \index{itk::GDCMSeriesFileNames!SetDirectory()}
     //
     // Software Guide : EndLatex
+#if USE_DIRECTORY_WATCH
+    // Start watching before the directory is listed, so that nothing written in between is missed (anything
+    // reported that the listing also had is skipped by AddFiles)
+    SeriesDirectoryWatcher watcher( argv[1] );
+#endif
     // Software Guide : BeginCodeSnippet
     typedef itk::GDCMSeriesFileNames NamesGeneratorType;
     NamesGeneratorType::Pointer nameGenerator = NamesGeneratorType::New();
@@ -244,6 +406,72 @@ int main( int argc, char* argv[] )
         FileNamesContainer fileNames;
         fileNames = nameGenerator->GetFileNames( seriesIdentifier );
         // Software Guide : EndCodeSnippet
+        // Filled in by whichever of the loading paths below can do it as a side effect
+        IntensityHistogram histogram;
+#if USE_SHARED_VOLUME
+        // Anything below that changes the volume's extent or voxels has to give it a different name
+#if USE_PIPELINED_LOADING
+        std::string processing = "cropped";
+#elif USE_LOW_MEMORY_PIPELINE
+        std::string processing = "uncropped";
+#else
+        std::string processing = "cropped";
+#if USE_SLAB_LIMITED_READER
+        if ( argc > 4 )
+        {
+            processing += std::string( " slices " ) + argv[3] + "-" + argv[4];
+        }
+#endif
+#if USE_EMPTY_BRICK_SKIPPING
+        processing += " empty bricks filled";
+#endif
+#endif
+        const std::string sharedName = SharedVolume::GetNameForSeries( seriesIdentifier, processing );
+        vtkSmartPointer<vtkImageData> volume = SharedVolume::Map( sharedName );
+        
+        // Once we've published it, it's ours to take down again however we leave here (anyone who has mapped
+        // it keeps their mapping)
+        struct SharedVolumeOwner
+        {
+            std::string Name;
+            ~SharedVolumeOwner()
+            {
+                if ( !this->Name.empty() )
+                {
+                    SharedVolume::Unpublish( this->Name );
+                }
+            }
+        } sharedVolumeOwner;
+        if ( volume )
+        {
+            std::cout << "Using shared volume " << sharedName << std::endl;
+        }
+        else
+        {
+#endif
+#if USE_DIRECTORY_WATCH
+        // Keep the decoded slices so that slices arriving later only cost their own decode and filtering
+        IncrementalSeriesVolume< ImageType > liveSeries;
+        liveSeries.SetSeriesIdentifier( seriesIdentifier );
+        liveSeries.AddFiles( fileNames );
+        vtkSmartPointer<vtkImageData> loadedVolume = liveSeries.GetOutput();
+#elif USE_TIME_SERIES
+        // Only the headers for now; the time points are read and filtered as they are shown
+        TimeSeriesVolume< ImageType > timeSeries;
+        if ( timeSeries.SetFileNames( fileNames ) == 0 )
+        {
+            std::cerr << "No readable slices in the series" << std::endl;
+            return EXIT_FAILURE;
+        }
+        timeSeries.ShowFrame( 0 );
+        vtkSmartPointer<vtkImageData> loadedVolume = timeSeries.GetOutput();
+#elif USE_PIPELINED_LOADING
+        // Decode, filter and convert in one go, with the stages overlapping
+        PipelinedSeriesLoader< ImageType > loader;
+        loader.SetFileNames( fileNames );
+        vtkSmartPointer<vtkImageData> loadedVolume = loader.Load();
+        histogram = loader.GetHistogram();
+#else
         // Software Guide : BeginLatex
         //
         //
@@ -266,7 +494,12 @@ int main( int argc, char* argv[] )
         // Software Guide : BeginCodeSnippet
         try
         {
+#if USE_SLAB_LIMITED_READER
+            // Only the geometry for now - the pixel data is pulled through by the filters below
+            reader->UpdateOutputInformation();
+#else
             reader->Update();
+#endif
         }
         catch (itk::ExceptionObject &ex)
         {
@@ -285,9 +518,52 @@ int main( int argc, char* argv[] )
         typedef BoxCarSmoothFilter<ImageType> FilterType;
         FilterType::Pointer boxCarFilter = FilterType::New();
         boxCarFilter->SetInput(reader->GetOutput());
+#if USE_WORK_STEALING_FILTER
+        boxCarFilter->UseWorkStealingOn();
+#endif
+#if USE_NUMA_PLACEMENT
+        boxCarFilter->UseNumaPlacementOn();
+#endif
+#if USE_EMPTY_BRICK_SKIPPING
+        boxCarFilter->SkipEmptyBricksOn();
+        boxCarFilter->SetEmptyThreshold(-500);
+        boxCarFilter->SetEmptyBrickValue(-1000);
+#endif
+#if USE_BUFFER_POOL
+        boxCarFilter->UseBufferPoolOn();
+#endif
+#if USE_AUTO_WINDOW_LEVEL
+        boxCarFilter->ComputeHistogramOn();
+#endif
+#if USE_AUTOTUNED_FILTER
+        BoxCarAutotuner< ImageType > autotuner;
+        BoxCarAutotuner< ImageType >::Apply( autotuner.GetConfiguration(), boxCarFilter.GetPointer() );
+#endif
         
+#if USE_LOW_MEMORY_PIPELINE
+        // In place, the boundary voxels are handled by clamping, so there is no need to inset (or crop) anything
+        boxCarFilter->InPlaceOn();
+        reader->ReleaseDataFlagOn();
+        boxCarFilter->GetOutput()->SetRequestedRegion(reader->GetOutput()->GetLargestPossibleRegion());
+        boxCarFilter->Update();
+#else
         // Only ask for inset region so that we don't have problems with boundaries
         typename ImageType::RegionType region = reader->GetOutput()->GetLargestPossibleRegion();
+#if USE_SLAB_LIMITED_READER
+        if ( argc > 4 )
+        {
+            // Restrict to the requested slab of slices. Note that the inset below takes one slice off each end.
+            const long firstSlice = std::max( atol( argv[3] ), static_cast< long >( region.GetIndex()[2] ) );
+            const long lastSlice = std::min( atol( argv[4] ), static_cast< long >( region.GetIndex()[2] + region.GetSize()[2] - 1 ) );
+            if ( lastSlice - firstSlice < 2 )
+            {
+                std::cerr << "Slab must contain at least three slices" << std::endl;
+                return EXIT_FAILURE;
+            }
+            region.SetIndex( 2, firstSlice );
+            region.SetSize( 2, lastSlice - firstSlice + 1 );
+        }
+#endif
         typename ImageType::RegionType insetRegion;
         insetRegion.SetIndex( { {region.GetIndex()[0]+1, region.GetIndex()[1]+1, region.GetIndex()[2]+1} } );
         insetRegion.SetSize( { {region.GetSize()[0]-2, region.GetSize()[1]-2, region.GetSize()[2]-2} } );
@@ -302,21 +578,85 @@ int main( int argc, char* argv[] )
         CropFilterType::Pointer cropFilter = CropFilterType::New();
         cropFilter->SetInput(boxCarFilter->GetOutput());
         
+#if USE_SLAB_LIMITED_READER
+        // Crop down to exactly the region we filtered, which may only be a slab of the whole series. Asking for
+        // anything bigger would make the reader go back and decode the rest of the files.
+        const ImageType::RegionType largestRegion = reader->GetOutput()->GetLargestPossibleRegion();
+        ImageType::SizeType lowerCropSize;
+        ImageType::SizeType upperCropSize;
+        for ( unsigned int i = 0; i < Dimension; ++i )
+        {
+            lowerCropSize[i] = insetRegion.GetIndex()[i] - largestRegion.GetIndex()[i];
+            upperCropSize[i] = largestRegion.GetUpperIndex()[i] - insetRegion.GetUpperIndex()[i];
+        }
+        cropFilter->SetLowerBoundaryCropSize(lowerCropSize);
+        cropFilter->SetUpperBoundaryCropSize(upperCropSize);
+#else
         // Equal cropping of 1 voxel all the way around
         ImageType::SizeType cropSize;
         cropSize.Fill(2);
         cropFilter->SetBoundaryCropSize(cropSize);
+#endif
+#endif
+        
+#if USE_AUTO_WINDOW_LEVEL
+        histogram = boxCarFilter->GetHistogram();
+#endif
         
         // TGW: snip - remove writer code from DicomSeriesReadImageWrite2.cxx and replace with renderer
         typedef itk::ImageToVTKImageFilter<ImageType> ConnectorType;
         ConnectorType::Pointer connector = ConnectorType::New();
+#if USE_LOW_MEMORY_PIPELINE
+        // The connector passes the ITK buffer pointer straight to VTK, so this doesn't copy the volume
+        connector->SetInput(boxCarFilter->GetOutput());
+#else
         connector->SetInput(cropFilter->GetOutput());
+#endif
         connector->Update();
+        vtkSmartPointer<vtkImageData> loadedVolume = connector->GetOutput();
+#endif
+#if USE_SHARED_VOLUME
+        // Use the shared copy ourselves as well, since the ITK pipeline that owns loadedVolume's voxels goes
+        // out of scope here
+        if ( SharedVolume::Publish( sharedName, loadedVolume ) )
+        {
+            std::cout << "Published shared volume " << sharedName << std::endl;
+            sharedVolumeOwner.Name = sharedName;
+            volume = SharedVolume::Map( sharedName );
+        }
+        if ( !volume )
+        {
+            volume = vtkSmartPointer<vtkImageData>::New();
+            volume->DeepCopy( loadedVolume );
+        }
+        }
+#else
+        vtkSmartPointer<vtkImageData> volume = loadedVolume;
+#endif
+#if USE_COMPRESSED_VOLUME
+        CompressedBrickVolume compressedVolume;
+        if ( !compressedVolume.Compress( volume ) )
+        {
+            std::cerr << "Only signed short volumes can be compressed" << std::endl;
+            return EXIT_FAILURE;
+        }
+        // From here on only the compressed copy holds the voxels
+        volume = compressedVolume.GetGeometry();
+        loadedVolume->ReleaseData();
+#if !USE_PIPELINED_LOADING
+        connector->GetOutput()->ReleaseData();
+#if !USE_LOW_MEMORY_PIPELINE
+        cropFilter->GetOutput()->ReleaseData();
+#endif
+        boxCarFilter->GetOutput()->ReleaseData();
+        reader->GetOutput()->ReleaseData();
+#endif
+#endif
         
 #if USE_BASIC_IMAGE_VIEWER_APPROACH
         
         vtkSmartPointer<vtkImageActor> actor = vtkSmartPointer<vtkImageActor>::New();
-        actor->GetMapper()->SetInputData(connector->GetOutput());
+        actor->GetMapper()->SetInputData(volume);
         
         vtkSmartPointer<vtkRenderer> renderer = vtkSmartPointer<vtkRenderer>::New();
         renderer->AddActor(actor);
@@ -340,7 +680,7 @@ int main( int argc, char* argv[] )
         //        vtkSmartPointer<vtkRenderWindowInteractor> renderWindowInteractor = vtkSmartPointer<vtkRenderWindowInteractor>::New();
         //        vtkSmartPointer<vtkImageViewer> viewer = vtkImageViewer::New();
         //        viewer->SetupInteractor(renderWindowInteractor);
-        //        viewer->SetInputData(connector->GetOutput());
+        //        viewer->SetInputData(volume);
         //        viewer->Render();
         //        viewer->SetColorWindow(1000);
         //        viewer->SetColorLevel(500);
@@ -349,9 +689,9 @@ int main( int argc, char* argv[] )
         int extent[6];
         double spacing[3];
         double origin[3];
-        connector->GetOutput()->GetExtent(extent);
-        connector->GetOutput()->GetSpacing(spacing);
-        connector->GetOutput()->GetOrigin(origin);
+        volume->GetExtent(extent);
+        volume->GetSpacing(spacing);
+        volume->GetOrigin(origin);
         
         double center[3];
         center[0] = origin[0] + spacing[0] * 0.5 * (extent[0] + extent[1]);
@@ -377,45 +717,97 @@ int main( int argc, char* argv[] )
             0,-1, 0, 0,
             0, 0, 0, 1 };
         
-        //static double obliqueElements[16] = {
-        //         1, 0, 0, 0,
-        //         0, 0.866025, -0.5, 0,
-        //         0, 0.5, 0.866025, 0,
-        //         0, 0, 0, 1 };
+#if USE_OBLIQUE_VIEW
+        static double obliqueElements[16] = {
+                 1, 0, 0, 0,
+                 0, 0.866025, -0.5, 0,
+                 0, 0.5, 0.866025, 0,
+                 0, 0, 0, 1 };
+#endif
         
         // Set the slice orientation
         vtkSmartPointer<vtkMatrix4x4> resliceAxes = vtkSmartPointer<vtkMatrix4x4>::New();
+#if USE_OBLIQUE_VIEW
+        resliceAxes->DeepCopy(obliqueElements);
+#else
         resliceAxes->DeepCopy(axialElements);
+#endif
         // Set the point through which to slice
         resliceAxes->SetElement(0, 3, center[0]);
         resliceAxes->SetElement(1, 3, center[1]);
         resliceAxes->SetElement(2, 3, center[2]);
         
         // Extract a slice in the desired orientation
+#if USE_COMPRESSED_VOLUME
+        vtkSmartPointer<vtkImageCompressedReslice> compressedReslice = vtkSmartPointer<vtkImageCompressedReslice>::New();
+        compressedReslice->SetCompressedVolume(&compressedVolume);
+        vtkSmartPointer<vtkImageReslice> reslice = compressedReslice;
+#elif USE_FIXED_POINT_RESLICE
+        vtkSmartPointer<vtkImageReslice> reslice = vtkSmartPointer<vtkImageFixedPointReslice>::New();
+#elif USE_BUFFER_POOL
+        vtkSmartPointer<vtkImageReslice> reslice = vtkSmartPointer<vtkPooledImageReslice>::New();
+#else
         vtkSmartPointer<vtkImageReslice> reslice = vtkSmartPointer<vtkImageReslice>::New();
-        reslice->SetInputData(connector->GetOutput());
+#endif
+        reslice->SetInputData(volume);
         reslice->SetOutputDimensionality(2);
         reslice->SetResliceAxes(resliceAxes);
         reslice->SetInterpolationModeToLinear();
+#if USE_THICK_SLAB
+        // Reslice the whole slab as a stack of thin slices, then project them down to one image
+        vtkImageSlabProjection::ConfigureSlabReslice(reslice, SLAB_THICKNESS);
+        vtkSmartPointer<vtkImageSlabProjection> slabProjection = vtkSmartPointer<vtkImageSlabProjection>::New();
+        slabProjection->SetModeToMaximum();
+        slabProjection->SetInputConnection(reslice->GetOutputPort());
+        slabProjection->Update();
+#else
         reslice->Update();
+#endif
         
         // Create a greyscale lookup table
         vtkSmartPointer<vtkLookupTable> table = vtkSmartPointer<vtkLookupTable>::New();
+#if USE_AUTO_WINDOW_LEVEL
+        if ( !histogram.IsEmpty() )
+        {
+            const std::vector< IntensityHistogram::WindowLevelPreset > presets = histogram.GetWindowLevelPresets();
+            for ( std::size_t p = 0; p < presets.size(); ++p )
+            {
+                std::cout << "Window/level preset " << presets[p].Name << ": " << presets[p].Window << " / " << presets[p].Level << std::endl;
+            }
+            table->SetRange(presets[0].Level - 0.5 * presets[0].Window, presets[0].Level + 0.5 * presets[0].Window);
+        }
+        else
+        {
+            table->SetRange(0, 1000);
+        }
+#else
         table->SetRange(0, 1000); // image intensity range
+#endif
         table->SetValueRange(0.0, 1.0); // from black to white
         table->SetSaturationRange(0.0, 0.0); // no color saturation
         table->SetRampToLinear();
         table->Build();
         
         // Map the image through the lookup table
+#if USE_BUFFER_POOL
+        vtkSmartPointer<vtkImageMapToColors> color = vtkSmartPointer<vtkPooledImageMapToColors>::New();
+#else
         vtkSmartPointer<vtkImageMapToColors> color = vtkSmartPointer<vtkImageMapToColors>::New();
+#endif
         color->SetLookupTable(table);
+#if USE_THICK_SLAB
+        color->SetInputData(slabProjection->GetOutput());
+#else
         color->SetInputData(reslice->GetOutput());
+#endif
         color->Update();
         
-        // Display the image
+        // Display the image. The actor has an image of its own, which the callback (and anything else that
+        // changes the slice) points at either the colours' output or a finished slice from elsewhere.
+        vtkSmartPointer<vtkImageData> displayImage = vtkSmartPointer<vtkImageData>::New();
+        displayImage->ShallowCopy(color->GetOutput());
         vtkSmartPointer<vtkImageActor> actor = vtkSmartPointer<vtkImageActor>::New();
-        actor->SetInputData(color->GetOutput());
+        actor->SetInputData(displayImage);
         
         vtkSmartPointer<vtkRenderer> renderer = vtkSmartPointer<vtkRenderer>::New();
         renderer->AddActor(actor);
@@ -433,15 +825,196 @@ int main( int argc, char* argv[] )
         vtkSmartPointer<vtkImageInteractionCallback> callback = vtkSmartPointer<vtkImageInteractionCallback>::New();
         callback->SetImageReslice(reslice);
         callback->SetImageColors(color); ///WHY ARE WE HAVING TO SET THIS????
+        callback->SetDisplayImage(displayImage);
+#if USE_THICK_SLAB
+        callback->SetSlabProjection(slabProjection);
+#endif
         callback->SetInteractor(interactor);
+#if USE_SLICE_CACHE
+        SliceCache sliceCache;
+        callback->SetSliceCache(&sliceCache);
+#endif
+#if USE_CINE
+        CinePlayer cinePlayer;
+        cinePlayer.SetFrameRate(CINE_FRAME_RATE);
+        callback->SetCinePlayer(&cinePlayer);
+        interactor->AddObserver(vtkCommand::TimerEvent, callback);
+#endif
         
         imageStyle->AddObserver(vtkCommand::MouseMoveEvent, callback);
         imageStyle->AddObserver(vtkCommand::LeftButtonPressEvent, callback);
         imageStyle->AddObserver(vtkCommand::LeftButtonReleaseEvent, callback);
+        imageStyle->AddObserver(vtkCommand::KeyPressEvent, callback);
+        
+#if USE_DIRECTORY_WATCH
+        // Check for new slices twice a second, and redraw the current slice if any came in
+        struct LiveUpdate
+        {
+            SeriesDirectoryWatcher* Watcher;
+            IncrementalSeriesVolume< ImageType >* Series;
+            vtkImageReslice* Reslice;
+            vtkAlgorithm* SlabProjection;
+            vtkImageMapToColors* Colors;
+            vtkImageData* Display;
+            vtkRenderWindowInteractor* Interactor;
+            SliceCache* Cache;
+            CinePlayer* Cine;
+            int TimerId;
+            
+            static void Poll(vtkObject*, unsigned long, void* clientData, void* callData)
+            {
+                LiveUpdate* update = static_cast<LiveUpdate*>(clientData);
+                if ( !callData || *static_cast<int*>(callData) != update->TimerId )
+                {
+                    return;
+                }
+                const std::vector< std::string > newFiles = update->Watcher->GetNewFiles();
+                if ( !newFiles.empty() )
+                {
+                    // The volume's buffers are about to move, and the cached slices are out of date anyway
+                    if ( update->Cache )
+                    {
+                        update->Cache->Clear();
+                    }
+                    if ( update->Cine )
+                    {
+                        update->Cine->Stop();
+                    }
+                }
+                if ( !newFiles.empty() && update->Series->AddFiles( newFiles ) > 0 )
+                {
+                    update->Reslice->Update();
+                    if ( update->SlabProjection )
+                    {
+                        update->SlabProjection->Update();
+                    }
+                    update->Colors->Update();
+                    update->Display->ShallowCopy(update->Colors->GetOutput());
+                    update->Display->Modified();
+                    update->Interactor->Render();
+                }
+            }
+        };
+#if USE_THICK_SLAB
+        LiveUpdate liveUpdate = { &watcher, &liveSeries, reslice, slabProjection, color, displayImage, interactor, callback->GetSliceCache(), callback->GetCinePlayer(), -1 };
+#else
+        LiveUpdate liveUpdate = { &watcher, &liveSeries, reslice, nullptr, color, displayImage, interactor, callback->GetSliceCache(), callback->GetCinePlayer(), -1 };
+#endif
+        vtkSmartPointer<vtkCallbackCommand> poll = vtkSmartPointer<vtkCallbackCommand>::New();
+        poll->SetCallback(LiveUpdate::Poll);
+        poll->SetClientData(&liveUpdate);
+        interactor->Initialize();
+        interactor->AddObserver(vtkCommand::TimerEvent, poll);
+        liveUpdate.TimerId = interactor->CreateRepeatingTimer(500);
+#endif
+        
+#if USE_TIME_SERIES
+        // Step or play through the time points, keeping the reslice axes (so the same slice) as they are
+        struct TimeStepper
+        {
+            TimeSeriesVolume< ImageType >* Series;
+            vtkImageReslice* Reslice;
+            vtkAlgorithm* SlabProjection;
+            vtkImageMapToColors* Colors;
+            vtkImageData* Display;
+            vtkRenderWindowInteractor* Interactor;
+            SliceCache* Cache;
+            CinePlayer* Cine;
+            int TimerId;
+            
+            void Show(int step)
+            {
+                const unsigned int numberOfFrames = this->Series->GetNumberOfFrames();
+                const unsigned int frame = ( this->Series->GetCurrentFrame() + numberOfFrames + step ) % numberOfFrames;
+                // The cached slices are of the old time point, and the old volume's buffer is about to be reused
+                if ( this->Cache )
+                {
+                    this->Cache->Clear();
+                }
+                if ( this->Cine )
+                {
+                    this->Cine->Stop();
+                }
+                try
+                {
+                    this->Series->ShowFrame(frame, step);
+                }
+                catch (itk::ExceptionObject& ex)
+                {
+                    std::cerr << "Can't show time point " << frame << ": " << ex.GetDescription() << std::endl;
+                    return;
+                }
+                catch (std::exception& ex)
+                {
+                    // Say running out of memory, or a thread failing to start, while loading it
+                    std::cerr << "Can't show time point " << frame << ": " << ex.what() << std::endl;
+                    return;
+                }
+                this->Reslice->Update();
+                if ( this->SlabProjection )
+                {
+                    this->SlabProjection->Update();
+                }
+                this->Colors->Update();
+                this->Display->ShallowCopy(this->Colors->GetOutput());
+                this->Display->Modified();
+                this->Interactor->Render();
+            }
+            
+            static void Execute(vtkObject*, unsigned long event, void* clientData, void* callData)
+            {
+                TimeStepper* stepper = static_cast<TimeStepper*>(clientData);
+                if ( event == vtkCommand::TimerEvent )
+                {
+                    if ( callData && *static_cast<int*>(callData) == stepper->TimerId )
+                    {
+                        stepper->Show(1);
+                    }
+                    return;
+                }
+                
+                const std::string key = stepper->Interactor->GetKeySym() ? stepper->Interactor->GetKeySym() : "";
+                if ( key == "Right" )
+                {
+                    stepper->Show(1);
+                }
+                else if ( key == "Left" )
+                {
+                    stepper->Show(-1);
+                }
+                else if ( key == "t" )
+                {
+                    if ( stepper->TimerId >= 0 )
+                    {
+                        stepper->Interactor->DestroyTimer(stepper->TimerId);
+                        stepper->TimerId = -1;
+                    }
+                    else
+                    {
+                        stepper->TimerId = stepper->Interactor->CreateRepeatingTimer(static_cast<unsigned long>(1000.0 / TIME_FRAME_RATE));
+                    }
+                }
+            }
+        };
+        std::cout << timeSeries.GetNumberOfFrames() << " time points: Right/Left to step, t to play/pause" << std::endl;
+#if USE_THICK_SLAB
+        TimeStepper timeStepper = { &timeSeries, reslice, slabProjection, color, displayImage, interactor, callback->GetSliceCache(), callback->GetCinePlayer(), -1 };
+#else
+        TimeStepper timeStepper = { &timeSeries, reslice, nullptr, color, displayImage, interactor, callback->GetSliceCache(), callback->GetCinePlayer(), -1 };
+#endif
+        vtkSmartPointer<vtkCallbackCommand> timeStep = vtkSmartPointer<vtkCallbackCommand>::New();
+        timeStep->SetCallback(TimeStepper::Execute);
+        timeStep->SetClientData(&timeStepper);
+        interactor->Initialize();
+        imageStyle->AddObserver(vtkCommand::KeyPressEvent, timeStep);
+        interactor->AddObserver(vtkCommand::TimerEvent, timeStep);
+#endif
         
         // Start interaction
         // The Start() method doesn't return until the window is closed by the user
         interactor->Start();
+        std::cout << "Handled " << callback->GetNumberOfTimedEvents() << " interaction events, mean "
+                  << callback->GetMeanEventLatency() << " us, worst " << callback->GetMaximumEventLatency() << " us" << std::endl;
 #endif
         
     }
@@ -0,0 +1,113 @@
+//
+//  TimeSeriesVolume.h
+//  ImageSlicing
+//
+//  Created by Tom on 21/09/2016.
+//
+//
+
+#ifndef TimeSeriesVolume_h
+#define TimeSeriesVolume_h
+
+#include "vtkSmartPointer.h"
+#include "vtkImageData.h"
+
+#include <future>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * A 4D study (perfusion, cardiac) as a series of box-car filtered volumes of the same geometry, one per time
+ * point, of which only a few are in memory at once. SetFileNames() sorts the files into time points (by
+ * temporal position identifier, trigger time or acquisition time, the first that splits the series into
+ * volumes of the same slice positions, or failing that by how often each slice position repeats) and each of
+ * those into slice order, reading only the headers.
+ *
+ * Frames are read and filtered when they're asked for, one at a time, by a DicomSlabSeriesReader feeding an
+ * in-place BoxCarSmoothFilter, both taking their buffers from VolumeBufferPool. Since every frame is the same
+ * size, once the window of resident frames is full each new frame reuses the buffer of the one it pushes out.
+ * ShowFrame() also starts loading the next frame in the direction of travel in the background, so stepping
+ * or playing through time mostly finds it ready.
+ */
+template< typename TImage >
+class TimeSeriesVolume
+{
+public:
+
+    typedef std::vector< std::string > FileNamesContainer;
+
+    TimeSeriesVolume();
+    ~TimeSeriesVolume();
+
+    // All the files of the series, in any order. Returns the number of time points (1 for a plain 3D series).
+    // Throws itk::ExceptionObject if slice positions repeat but can't be sorted into matching time points.
+    unsigned int SetFileNames( const FileNamesContainer& fileNames );
+
+    unsigned int GetNumberOfFrames() const { return static_cast< unsigned int >( this->Frames.size() ); }
+
+    // Whatever the files were grouped by (seconds for the times)
+    double GetFrameTime( unsigned int frame ) const { return this->Frames[frame].Time; }
+
+    // Frames kept in memory, counting the one being shown and the one being fetched, 3 to start with
+    void SetMaximumResidentFrames( unsigned int frames ) { this->MaximumResidentFrames = frames; }
+
+    // Point the output at this frame, loading it first if need be, and start loading frame + direction
+    // (wrapping round) in the background. Throws itk::ExceptionObject if the frame can't be read.
+    void ShowFrame( unsigned int frame, int direction = 1 );
+
+    unsigned int GetCurrentFrame() const { return this->CurrentFrame; }
+
+    // The same object for the life of this one; ShowFrame repoints it (and calls Modified)
+    vtkImageData* GetOutput() const { return this->Output; }
+
+private:
+
+    TimeSeriesVolume( const TimeSeriesVolume& );
+    void operator=( const TimeSeriesVolume& );
+
+    struct TimePoint
+    {
+        double Time;
+        FileNamesContainer FileNames;
+    };
+
+    // A filtered frame; the VTK image uses the ITK image's buffer
+    struct Frame
+    {
+        typename TImage::Pointer Image;
+        vtkSmartPointer<vtkImageData> Volume;
+    };
+    typedef std::shared_ptr< const Frame > FramePointer;
+
+    struct CacheEntry
+    {
+        std::shared_future< FramePointer > Frame;
+        std::list< unsigned int >::iterator LruPosition;
+    };
+
+    // Read and filter one frame (on whichever thread)
+    FramePointer LoadFrame( unsigned int frame ) const;
+
+    // The frame's future, starting the load if it isn't resident or on its way, and dropping the least recently
+    // used frames beyond the limit (but never one still loading, or keep)
+    std::shared_future< FramePointer > RequestFrame( unsigned int frame, unsigned int keep );
+
+    std::vector< TimePoint > Frames;
+    unsigned int MaximumResidentFrames;
+    unsigned int CurrentFrame;
+
+    std::mutex Mutex;
+    std::map< unsigned int, CacheEntry > Cache;
+    std::list< unsigned int > LruOrder;
+
+    FramePointer Current;
+    vtkSmartPointer<vtkImageData> Output;
+};
+
+#include "TimeSeriesVolume.hxx"
+
+#endif /* TimeSeriesVolume_h */
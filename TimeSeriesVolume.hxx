@@ -0,0 +1,373 @@
+//
+//  TimeSeriesVolume.hxx
+//  ImageSlicing
+//
+//  Created by Tom on 21/09/2016.
+//
+//
+
+#ifndef TimeSeriesVolume_hxx
+#define TimeSeriesVolume_hxx
+
+#include "TimeSeriesVolume.h"
+
+#include "BoxCarSmoothFilter.h"
+#include "DicomSlabSeriesReader.h"
+
+#include "itkGDCMImageIO.h"
+#include "itkTimeProbe.h"
+#include "vtkDataArray.h"
+#include "vtkPointData.h"
+#include "vtkTypeTraits.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <set>
+#include <utility>
+
+namespace TimeSeriesVolumeDetail
+{
+    // Tags that can tell the time points apart, best first
+    const char* const TimeTags[] = { "0020|0100", "0018|1060", "0008|0032" };
+
+    // Acquisition time is HHMMSS.FFFFFF; the others are plain numbers
+    inline double ParseTime( const std::string& tag, const std::string& value )
+    {
+        if ( tag != "0008|0032" || value.size() < 6 )
+        {
+            return std::atof( value.c_str() );
+        }
+        return std::atof( value.substr( 0, 2 ).c_str() ) * 3600.0 + std::atof( value.substr( 2, 2 ).c_str() ) * 60.0
+             + std::atof( value.substr( 4 ).c_str() );
+    }
+
+    // Slices closer than this along the normal are at the same position
+    const double PositionTolerance = 1e-3;
+
+    // Time -> (position, file name) of each slice at that time
+    typedef std::map< double, std::vector< std::pair< double, std::string > > > SliceGroups;
+
+    // Whether the groups are proper time points: more than one of them, each with the same number (more than
+    // one) of slices, and no two slices of one at the same position. Sorts each group by position.
+    inline bool AreTimePoints( SliceGroups& groups )
+    {
+        if ( groups.size() < 2 || groups.begin()->second.size() < 2 )
+        {
+            return false;
+        }
+        for ( SliceGroups::iterator g = groups.begin(); g != groups.end(); ++g )
+        {
+            if ( g->second.size() != groups.begin()->second.size() )
+            {
+                return false;
+            }
+            std::sort( g->second.begin(), g->second.end() );
+            for ( std::size_t s = 1; s < g->second.size(); ++s )
+            {
+                if ( g->second[s].first - g->second[s - 1].first < PositionTolerance )
+                {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+}
+
+template< typename TImage >
+TimeSeriesVolume< TImage >::TimeSeriesVolume()
+: MaximumResidentFrames( 3 ), CurrentFrame( 0 ), Output( vtkSmartPointer<vtkImageData>::New() )
+{
+}
+
+template< typename TImage >
+TimeSeriesVolume< TImage >::~TimeSeriesVolume()
+{
+    // Wait for any background loads, which use this object, before the members go
+    std::map< unsigned int, CacheEntry > cache;
+    {
+        std::lock_guard< std::mutex > lock( this->Mutex );
+        cache.swap( this->Cache );
+        this->LruOrder.clear();
+    }
+    for ( typename std::map< unsigned int, CacheEntry >::iterator i = cache.begin(); i != cache.end(); ++i )
+    {
+        i->second.Frame.wait();
+    }
+}
+
+template< typename TImage >
+unsigned int TimeSeriesVolume< TImage >::SetFileNames( const FileNamesContainer& fileNames )
+{
+    itk::TimeProbe clock;
+    clock.Start();
+
+    // Headers only: the time tags, and where each slice is along the normal
+    struct SliceInfo
+    {
+        std::string FileName;
+        double Position;
+        std::string Times[3];
+    };
+    std::vector< SliceInfo > slices;
+    std::set< std::string > distinctTimes[3];
+    for ( std::size_t f = 0; f < fileNames.size(); ++f )
+    {
+        try
+        {
+            itk::GDCMImageIO::Pointer io = itk::GDCMImageIO::New();
+            io->SetFileName( fileNames[f] );
+            io->ReadImageInformation();
+
+            SliceInfo slice;
+            slice.FileName = fileNames[f];
+            slice.Position = 0;
+            const std::vector< double > normal = io->GetDirection( 2 );
+            for ( int i = 0; i < 3; ++i )
+            {
+                slice.Position += io->GetOrigin( i ) * normal[i];
+            }
+            for ( int t = 0; t < 3; ++t )
+            {
+                io->GetValueFromTag( TimeSeriesVolumeDetail::TimeTags[t], slice.Times[t] );
+                distinctTimes[t].insert( slice.Times[t] );
+            }
+            slices.push_back( slice );
+        }
+        catch ( itk::ExceptionObject& ex )
+        {
+            std::cerr << "Skipping " << fileNames[f] << ": " << ex.GetDescription() << std::endl;
+        }
+    }
+
+    // Group by the first tag that gives proper time points. Just varying isn't enough: acquisition time, for
+    // one, is often different for every slice of a plain 3D series.
+    typedef TimeSeriesVolumeDetail::SliceGroups SliceGroups;
+    SliceGroups groups;
+    std::string groupedBy;
+    for ( int t = 0; t < 3 && groupedBy.empty(); ++t )
+    {
+        if ( distinctTimes[t].size() < 2 )
+        {
+            continue;
+        }
+        groups.clear();
+        for ( std::size_t s = 0; s < slices.size(); ++s )
+        {
+            const double time = TimeSeriesVolumeDetail::ParseTime( TimeSeriesVolumeDetail::TimeTags[t], slices[s].Times[t] );
+            groups[time].push_back( std::make_pair( slices[s].Position, slices[s].FileName ) );
+        }
+        if ( TimeSeriesVolumeDetail::AreTimePoints( groups ) )
+        {
+            groupedBy = TimeSeriesVolumeDetail::TimeTags[t];
+        }
+    }
+
+    if ( groupedBy.empty() )
+    {
+        // Nothing to go on but the positions: the n-th slice at each position (in time tag order, as far as
+        // they say anything, then file name order) belongs to time point n
+        std::sort( slices.begin(), slices.end(), []( const SliceInfo& a, const SliceInfo& b )
+        {
+            for ( int t = 0; t < 3; ++t )
+            {
+                const double timeA = TimeSeriesVolumeDetail::ParseTime( TimeSeriesVolumeDetail::TimeTags[t], a.Times[t] );
+                const double timeB = TimeSeriesVolumeDetail::ParseTime( TimeSeriesVolumeDetail::TimeTags[t], b.Times[t] );
+                if ( timeA != timeB )
+                {
+                    return timeA < timeB;
+                }
+            }
+            return a.FileName < b.FileName;
+        } );
+        std::vector< std::pair< double, unsigned int > > positions;
+        groups.clear();
+        for ( std::size_t s = 0; s < slices.size(); ++s )
+        {
+            std::size_t p = 0;
+            while ( p < positions.size() && std::abs( positions[p].first - slices[s].Position ) >= TimeSeriesVolumeDetail::PositionTolerance )
+            {
+                ++p;
+            }
+            if ( p == positions.size() )
+            {
+                positions.push_back( std::make_pair( slices[s].Position, 0u ) );
+            }
+            groups[positions[p].second++].push_back( std::make_pair( slices[s].Position, slices[s].FileName ) );
+        }
+
+        if ( groups.size() > 1 )
+        {
+            if ( !TimeSeriesVolumeDetail::AreTimePoints( groups ) )
+            {
+                itkGenericExceptionMacro( << "Can't split the " << slices.size() << " slices into time points: no time tag gives time points "
+                                          << "with the same slices, and the slice positions don't repeat the same number of times each" );
+            }
+            groupedBy = "repeated slice positions";
+        }
+        else
+        {
+            // Every slice in its own place, so it's just one volume
+            for ( SliceGroups::iterator g = groups.begin(); g != groups.end(); ++g )
+            {
+                std::sort( g->second.begin(), g->second.end() );
+            }
+        }
+    }
+
+    {
+        std::lock_guard< std::mutex > lock( this->Mutex );
+        this->Frames.clear();
+        for ( SliceGroups::const_iterator g = groups.begin(); g != groups.end(); ++g )
+        {
+            TimePoint frame;
+            frame.Time = g->first;
+            for ( std::size_t s = 0; s < g->second.size(); ++s )
+            {
+                frame.FileNames.push_back( g->second[s].second );
+            }
+            this->Frames.push_back( frame );
+        }
+    }
+
+    clock.Stop();
+    std::cout << "Found " << this->Frames.size() << " time points in " << slices.size() << " files";
+    if ( !groupedBy.empty() )
+    {
+        std::cout << " (by " << groupedBy << ")";
+    }
+    std::cout << " in: " << clock.GetTotal() << std::endl;
+    return static_cast< unsigned int >( this->Frames.size() );
+}
+
+template< typename TImage >
+void TimeSeriesVolume< TImage >::ShowFrame( unsigned int frame, int direction )
+{
+    const unsigned int numberOfFrames = this->GetNumberOfFrames();
+    if ( frame >= numberOfFrames )
+    {
+        return;
+    }
+
+    itk::TimeProbe clock;
+    clock.Start();
+    std::shared_future< FramePointer > requested = this->RequestFrame( frame, frame );
+    const bool wasReady = requested.wait_for( std::chrono::seconds( 0 ) ) == std::future_status::ready;
+    FramePointer shown;
+    try
+    {
+        shown = requested.get();
+    }
+    catch ( ... )
+    {
+        // Forget the failed load so that asking again tries again
+        std::lock_guard< std::mutex > lock( this->Mutex );
+        typename std::map< unsigned int, CacheEntry >::iterator found = this->Cache.find( frame );
+        if ( found != this->Cache.end() )
+        {
+            this->LruOrder.erase( found->second.LruPosition );
+            this->Cache.erase( found );
+        }
+        throw;
+    }
+
+    // Repoint the output before letting go of the previous frame's buffer
+    this->Output->ShallowCopy( shown->Volume );
+    this->Output->Modified();
+    this->Current = shown;
+    this->CurrentFrame = frame;
+    clock.Stop();
+    if ( !wasReady )
+    {
+        std::cout << "Waited for time point " << frame << ": " << clock.GetTotal() << std::endl;
+    }
+
+    // Get the next one going while this one is looked at
+    if ( numberOfFrames > 1 && direction != 0 )
+    {
+        const unsigned int next = static_cast< unsigned int >( ( frame + numberOfFrames + ( direction > 0 ? 1 : -1 ) ) % numberOfFrames );
+        this->RequestFrame( next, frame );
+    }
+}
+
+template< typename TImage >
+std::shared_future< typename TimeSeriesVolume< TImage >::FramePointer >
+TimeSeriesVolume< TImage >::RequestFrame( unsigned int frame, unsigned int keep )
+{
+    std::lock_guard< std::mutex > lock( this->Mutex );
+    typename std::map< unsigned int, CacheEntry >::iterator found = this->Cache.find( frame );
+    if ( found != this->Cache.end() )
+    {
+        this->LruOrder.splice( this->LruOrder.begin(), this->LruOrder, found->second.LruPosition );
+        return found->second.Frame;
+    }
+
+    // Make room first, so that the new frame can take the buffers of the one it replaces
+    std::list< unsigned int >::iterator candidate = this->LruOrder.end();
+    while ( this->Cache.size() + 1 > this->MaximumResidentFrames && candidate != this->LruOrder.begin() )
+    {
+        --candidate;
+        const CacheEntry& entry = this->Cache.find( *candidate )->second;
+        if ( *candidate == keep || entry.Frame.wait_for( std::chrono::seconds( 0 ) ) != std::future_status::ready )
+        {
+            continue;
+        }
+        // The one on screen stays alive through Current until it's replaced
+        this->Cache.erase( *candidate );
+        candidate = this->LruOrder.erase( candidate );
+    }
+
+    CacheEntry entry;
+    entry.Frame = std::async( std::launch::async, &TimeSeriesVolume::LoadFrame, this, frame ).share();
+    this->LruOrder.push_front( frame );
+    entry.LruPosition = this->LruOrder.begin();
+    this->Cache[frame] = entry;
+    return entry.Frame;
+}
+
+template< typename TImage >
+typename TimeSeriesVolume< TImage >::FramePointer TimeSeriesVolume< TImage >::LoadFrame( unsigned int frame ) const
+{
+    typedef DicomSlabSeriesReader< TImage > ReaderType;
+    typedef BoxCarSmoothFilter< TImage > FilterType;
+    typedef typename TImage::PixelType PixelType;
+
+    // Same as the low memory pipeline in TgwSlicer: filter in place, in pooled buffers
+    typename ReaderType::Pointer reader = ReaderType::New();
+    reader->SetFileNames( this->Frames[frame].FileNames );
+    reader->UseBufferPoolOn();
+    reader->ReleaseDataFlagOn();
+    reader->UpdateOutputInformation();
+
+    typename FilterType::Pointer filter = FilterType::New();
+    filter->SetInput( reader->GetOutput() );
+    filter->UseBufferPoolOn();
+    filter->InPlaceOn();
+    filter->GetOutput()->SetRequestedRegion( reader->GetOutput()->GetLargestPossibleRegion() );
+    filter->ReportTimingOff();
+    filter->Update();
+
+    std::shared_ptr< Frame > result( new Frame );
+    result->Image = filter->GetOutput();
+    result->Image->DisconnectPipeline();
+
+    const typename TImage::RegionType region = result->Image->GetBufferedRegion();
+    result->Volume = vtkSmartPointer<vtkImageData>::New();
+    result->Volume->SetExtent( region.GetIndex()[0], region.GetUpperIndex()[0], region.GetIndex()[1], region.GetUpperIndex()[1],
+                               region.GetIndex()[2], region.GetUpperIndex()[2] );
+    result->Volume->SetSpacing( result->Image->GetSpacing()[0], result->Image->GetSpacing()[1], result->Image->GetSpacing()[2] );
+    result->Volume->SetOrigin( result->Image->GetOrigin()[0], result->Image->GetOrigin()[1], result->Image->GetOrigin()[2] );
+
+    // Borrow the ITK buffer, which the frame keeps alive for as long as VTK can see it
+    vtkSmartPointer<vtkDataArray> scalars;
+    scalars.TakeReference( vtkDataArray::CreateDataArray( vtkTypeTraits< PixelType >::VTKTypeID() ) );
+    scalars->SetNumberOfComponents( 1 );
+    scalars->SetVoidArray( result->Image->GetBufferPointer(), static_cast< vtkIdType >( region.GetNumberOfPixels() ), 1 );
+    result->Volume->GetPointData()->SetScalars( scalars );
+    return result;
+}
+
+#endif /* TimeSeriesVolume_hxx */
@@ -0,0 +1,150 @@
+//
+//  VolumeBufferPool.cpp
+//  ImageSlicing
+//
+//  Created by Tom on 27/08/2016.
+//
+//
+
+#include "VolumeBufferPool.h"
+
+#include <cstdlib>
+#include <new>
+
+VolumeBufferPool& VolumeBufferPool::GetGlobalPool()
+{
+    static VolumeBufferPool pool;
+    return pool;
+}
+
+VolumeBufferPool::VolumeBufferPool( std::size_t maximumRetainedBytes )
+: MaximumRetainedBytes( maximumRetainedBytes ), RetainedBytes( 0 ), NumberOfHits( 0 ), NumberOfMisses( 0 )
+{
+}
+
+VolumeBufferPool::~VolumeBufferPool()
+{
+    this->Clear();
+}
+
+std::size_t VolumeBufferPool::GetBucketSize( std::size_t bytes )
+{
+    // Round up to a multiple of an eighth of the largest power of two below the size (but at least a page)
+    std::size_t power = 1;
+    while ( power <= bytes / 2 )
+    {
+        power *= 2;
+    }
+    std::size_t step = power / 8;
+    if ( step < 4096 )
+    {
+        step = 4096;
+    }
+    return ( ( bytes + step - 1 ) / step ) * step;
+}
+
+void* VolumeBufferPool::Acquire( std::size_t bytes )
+{
+    const std::size_t bucket = GetBucketSize( bytes );
+    {
+        std::lock_guard< std::mutex > lock( this->Mutex );
+        std::map< std::size_t, std::vector< void* > >::iterator it = this->FreeBuffers.find( bucket );
+        if ( it != this->FreeBuffers.end() && !it->second.empty() )
+        {
+            void* buffer = it->second.back();
+            it->second.pop_back();
+            this->RetainedBytes -= bucket;
+            ++this->NumberOfHits;
+            return buffer;
+        }
+        ++this->NumberOfMisses;
+    }
+
+    void* buffer = std::malloc( bucket );
+    if ( !buffer )
+    {
+        // Give back whatever we're sitting on and try once more before giving up
+        this->Clear();
+        buffer = std::malloc( bucket );
+        if ( !buffer )
+        {
+            throw std::bad_alloc();
+        }
+    }
+    return buffer;
+}
+
+void VolumeBufferPool::Release( void* buffer, std::size_t bytes )
+{
+    if ( !buffer )
+    {
+        return;
+    }
+
+    const std::size_t bucket = GetBucketSize( bytes );
+    {
+        std::lock_guard< std::mutex > lock( this->Mutex );
+        if ( this->RetainedBytes + bucket <= this->MaximumRetainedBytes )
+        {
+            this->FreeBuffers[bucket].push_back( buffer );
+            this->RetainedBytes += bucket;
+            return;
+        }
+    }
+    std::free( buffer );
+}
+
+void VolumeBufferPool::Clear()
+{
+    this->TrimTo( 0 );
+}
+
+void VolumeBufferPool::SetMaximumRetainedBytes( std::size_t bytes )
+{
+    {
+        std::lock_guard< std::mutex > lock( this->Mutex );
+        this->MaximumRetainedBytes = bytes;
+    }
+    this->TrimTo( bytes );
+}
+
+void VolumeBufferPool::TrimTo( std::size_t bytes )
+{
+    std::vector< void* > toFree;
+    {
+        std::lock_guard< std::mutex > lock( this->Mutex );
+        // Biggest buckets first
+        std::map< std::size_t, std::vector< void* > >::reverse_iterator it = this->FreeBuffers.rbegin();
+        for ( ; it != this->FreeBuffers.rend() && this->RetainedBytes > bytes; ++it )
+        {
+            while ( !it->second.empty() && this->RetainedBytes > bytes )
+            {
+                toFree.push_back( it->second.back() );
+                it->second.pop_back();
+                this->RetainedBytes -= it->first;
+            }
+        }
+    }
+    for ( std::size_t i = 0; i < toFree.size(); ++i )
+    {
+        std::free( toFree[i] );
+    }
+}
+
+std::size_t VolumeBufferPool::GetRetainedBytes() const
+{
+    std::lock_guard< std::mutex > lock( this->Mutex );
+    return this->RetainedBytes;
+}
+
+std::size_t VolumeBufferPool::GetNumberOfHits() const
+{
+    std::lock_guard< std::mutex > lock( this->Mutex );
+    return this->NumberOfHits;
+}
+
+std::size_t VolumeBufferPool::GetNumberOfMisses() const
+{
+    std::lock_guard< std::mutex > lock( this->Mutex );
+    return this->NumberOfMisses;
+}
@@ -0,0 +1,69 @@
+//
+//  VolumeBufferPool.h
+//  ImageSlicing
+//
+//  Created by Tom on 27/08/2016.
+//
+//
+
+#ifndef VolumeBufferPool_h
+#define VolumeBufferPool_h
+
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <vector>
+
+/**
+ * Keeps hold of big buffers (whole volumes, slices) when they are freed, so the next allocation of the same
+ * size can have them straight back. Sizes are rounded up into buckets an eighth of a power of two apart, so
+ * at most ~12% is wasted, and a volume that is re-filtered (or a slice that is re-sliced) every update ends up
+ * reusing the same memory instead of going back to the allocator and faulting in fresh pages every time.
+ *
+ * Safe to use from several threads at once.
+ */
+class VolumeBufferPool
+{
+public:
+
+    // The one the image containers and VTK filters use unless told otherwise
+    static VolumeBufferPool& GetGlobalPool();
+
+    explicit VolumeBufferPool( std::size_t maximumRetainedBytes = std::size_t( 2 ) << 30 );
+    ~VolumeBufferPool();
+
+    // At least bytes long (actually GetBucketSize( bytes )), uninitialised
+    void* Acquire( std::size_t bytes );
+
+    // bytes must be what was passed to Acquire
+    void Release( void* buffer, std::size_t bytes );
+
+    // Free everything being kept
+    void Clear();
+
+    // Free buffers are only kept while the total stays under this
+    void SetMaximumRetainedBytes( std::size_t bytes );
+    std::size_t GetRetainedBytes() const;
+
+    // Acquires that were / weren't satisfied from the pool
+    std::size_t GetNumberOfHits() const;
+    std::size_t GetNumberOfMisses() const;
+
+    static std::size_t GetBucketSize( std::size_t bytes );
+
+private:
+
+    VolumeBufferPool( const VolumeBufferPool& );
+    void operator=( const VolumeBufferPool& );
+
+    void TrimTo( std::size_t bytes );
+
+    mutable std::mutex Mutex;
+    std::map< std::size_t, std::vector< void* > > FreeBuffers;
+    std::size_t MaximumRetainedBytes;
+    std::size_t RetainedBytes;
+    std::size_t NumberOfHits;
+    std::size_t NumberOfMisses;
+};
+
+#endif /* VolumeBufferPool_h */
@@ -0,0 +1,160 @@
+//
+//  WorkStealingExecutor.cpp
+//  ImageSlicing
+//
+//  Created by Tom on 20/08/2016.
+//
+//
+
+#include "WorkStealingExecutor.h"
+
+#include <algorithm>
+
+WorkStealingExecutor::WorkStealingExecutor( unsigned int numberOfThreads )
+: Generation( 0 ), TasksRemaining( 0 ), NumberOfSteals( 0 ), Stopping( false )
+{
+    if ( numberOfThreads == 0 )
+    {
+        numberOfThreads = std::max( 1u, std::thread::hardware_concurrency() );
+    }
+
+    for ( unsigned int t = 0; t < numberOfThreads; ++t )
+    {
+        this->Queues.push_back( new WorkerQueue );
+    }
+    for ( unsigned int t = 0; t < numberOfThreads; ++t )
+    {
+        this->Threads.push_back( std::thread( &WorkStealingExecutor::WorkerLoop, this, t ) );
+    }
+}
+
+WorkStealingExecutor::~WorkStealingExecutor()
+{
+    {
+        std::lock_guard< std::mutex > lock( this->Mutex );
+        this->Stopping = true;
+    }
+    this->WorkAvailable.notify_all();
+
+    for ( std::size_t t = 0; t < this->Threads.size(); ++t )
+    {
+        this->Threads[t].join();
+        delete this->Queues[t];
+    }
+}
+
+void WorkStealingExecutor::Run( const std::vector< TaskType >& tasks )
+{
+    if ( tasks.empty() )
+    {
+        return;
+    }
+
+    // Set the count first, as a worker still finishing off the last run may pick up a task as soon as it
+    // appears in a queue
+    {
+        std::lock_guard< std::mutex > lock( this->Mutex );
+        this->TasksRemaining = tasks.size();
+        this->NumberOfSteals = 0;
+        this->Failure = std::exception_ptr();
+    }
+
+    // Give each worker a contiguous block of tasks to start with
+    const std::size_t numberOfQueues = this->Queues.size();
+    for ( std::size_t q = 0; q < numberOfQueues; ++q )
+    {
+        const std::size_t begin = tasks.size() * q / numberOfQueues;
+        const std::size_t end = tasks.size() * ( q + 1 ) / numberOfQueues;
+        std::lock_guard< std::mutex > queueLock( this->Queues[q]->Mutex );
+        this->Queues[q]->Tasks.assign( tasks.begin() + begin, tasks.begin() + end );
+    }
+
+    std::unique_lock< std::mutex > lock( this->Mutex );
+    ++this->Generation;
+    this->WorkAvailable.notify_all();
+
+    this->WorkFinished.wait( lock, [this]() { return this->TasksRemaining == 0; } );
+
+    if ( this->Failure )
+    {
+        std::exception_ptr failure = this->Failure;
+        this->Failure = std::exception_ptr();
+        std::rethrow_exception( failure );
+    }
+}
+
+bool WorkStealingExecutor::NextTask( unsigned int index, TaskType& task )
+{
+    // Our own queue first, from the front so that we work through our block in order...
+    {
+        WorkerQueue* own = this->Queues[index];
+        std::lock_guard< std::mutex > lock( own->Mutex );
+        if ( !own->Tasks.empty() )
+        {
+            task = std::move( own->Tasks.front() );
+            own->Tasks.pop_front();
+            return true;
+        }
+    }
+
+    // ...then steal from the back of everyone else's, starting with our neighbour
+    const std::size_t numberOfQueues = this->Queues.size();
+    for ( std::size_t offset = 1; offset < numberOfQueues; ++offset )
+    {
+        WorkerQueue* victim = this->Queues[( index + offset ) % numberOfQueues];
+        std::lock_guard< std::mutex > lock( victim->Mutex );
+        if ( !victim->Tasks.empty() )
+        {
+            task = std::move( victim->Tasks.back() );
+            victim->Tasks.pop_back();
+
+            std::lock_guard< std::mutex > countLock( this->Mutex );
+            ++this->NumberOfSteals;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void WorkStealingExecutor::WorkerLoop( unsigned int index )
+{
+    unsigned long lastGeneration = 0;
+
+    for ( ;; )
+    {
+        {
+            std::unique_lock< std::mutex > lock( this->Mutex );
+            this->WorkAvailable.wait( lock, [&]() { return this->Stopping || this->Generation != lastGeneration; } );
+            if ( this->Stopping )
+            {
+                return;
+            }
+            lastGeneration = this->Generation;
+        }
+
+        TaskType task;
+        while ( this->NextTask( index, task ) )
+        {
+            std::exception_ptr failure;
+            try
+            {
+                task();
+            }
+            catch ( ... )
+            {
+                failure = std::current_exception();
+            }
+
+            std::lock_guard< std::mutex > lock( this->Mutex );
+            if ( failure && !this->Failure )
+            {
+                this->Failure = failure;
+            }
+            if ( --this->TasksRemaining == 0 )
+            {
+                this->WorkFinished.notify_all();
+            }
+        }
+    }
+}
@@ -0,0 +1,73 @@
+//
+//  WorkStealingExecutor.h
+//  ImageSlicing
+//
+//  Created by Tom on 20/08/2016.
+//
+//
+
+#ifndef WorkStealingExecutor_h
+#define WorkStealingExecutor_h
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * A small pool of worker threads, each with its own queue of tasks. Run() hands each worker a contiguous
+ * block of the tasks (so neighbouring rows/slabs stay on the same core), and any worker that runs out takes
+ * tasks from the far end of someone else's queue. This keeps all the cores busy right up to the end, even
+ * when the tasks have very different costs (e.g. the interior and the faces of a volume).
+ */
+class WorkStealingExecutor
+{
+public:
+
+    typedef std::function< void() > TaskType;
+
+    // 0 means one thread per core
+    explicit WorkStealingExecutor( unsigned int numberOfThreads = 0 );
+    ~WorkStealingExecutor();
+
+    // Run all the tasks and wait for them to finish. If any task throws, the first exception is rethrown here
+    // once everything else has finished.
+    void Run( const std::vector< TaskType >& tasks );
+
+    unsigned int GetNumberOfThreads() const { return static_cast< unsigned int >( this->Threads.size() ); }
+
+    // How many tasks were run by a worker other than the one they were given to, during the last Run()
+    std::size_t GetNumberOfSteals() const { return this->NumberOfSteals; }
+
+private:
+
+    WorkStealingExecutor( const WorkStealingExecutor& );
+    void operator=( const WorkStealingExecutor& );
+
+    struct WorkerQueue
+    {
+        std::mutex Mutex;
+        std::deque< TaskType > Tasks;
+    };
+
+    void WorkerLoop( unsigned int index );
+    bool NextTask( unsigned int index, TaskType& task );
+
+    std::vector< std::thread > Threads;
+    std::vector< WorkerQueue* > Queues;
+
+    // Protects everything below
+    std::mutex Mutex;
+    std::condition_variable WorkAvailable;
+    std::condition_variable WorkFinished;
+    unsigned long Generation;
+    std::size_t TasksRemaining;
+    std::size_t NumberOfSteals;
+    std::exception_ptr Failure;
+    bool Stopping;
+};
+
+#endif /* WorkStealingExecutor_h */
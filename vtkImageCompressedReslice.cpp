@@ -0,0 +1,210 @@
+//
+//  vtkImageCompressedReslice.cpp
+//  ImageSlicing
+//
+//  Created by Tom on 23/09/2016.
+//
+//
+
+#include "vtkImageCompressedReslice.hpp"
+
+#include "vtkImageData.h"
+#include "vtkInformation.h"
+#include "vtkInformationVector.h"
+#include "vtkObjectFactory.h"
+
+#include "CompressedBrickVolume.h"
+#include "FixedPointResliceKernel.h"
+
+#include <algorithm>
+
+vtkStandardNewMacro(vtkImageCompressedReslice);
+
+namespace
+{
+    const int BrickSize = CompressedBrickVolume::BrickSize;
+    const int BrickShift = 4;
+    static_assert(1 << BrickShift == CompressedBrickVolume::BrickSize, "BrickShift doesn't match the brick size");
+    
+    // One thread's view of the volume: holds on to the last few bricks it used, so that walking along a row
+    // only goes to the (locked) brick cache when it moves into a brick it hasn't just been in
+    class BrickSampler
+    {
+    public:
+        
+        explicit BrickSampler(CompressedBrickVolume *volume) : Volume(volume), Next(0)
+        {
+            std::fill(this->Keys, this->Keys + NumberOfPins, -1);
+        }
+        
+        // The brick holding voxel (x, y, z)
+        const short *Brick(int x, int y, int z)
+        {
+            const int bx = x >> BrickShift, by = y >> BrickShift, bz = z >> BrickShift;
+            const int *bricks = this->Volume->GetNumberOfBricks();
+            const long long key = bx + bricks[0] * (by + static_cast<long long>(bricks[1]) * bz);
+            for (int p = 0; p < NumberOfPins; ++p)
+            {
+                if (this->Keys[p] == key)
+                {
+                    return &(*this->Pins[p])[0];
+                }
+            }
+            this->Keys[this->Next] = key;
+            this->Pins[this->Next] = this->Volume->GetBrick(bx, by, bz);
+            const short *brick = &(*this->Pins[this->Next])[0];
+            this->Next = (this->Next + 1) % NumberOfPins;
+            return brick;
+        }
+        
+        short Voxel(int x, int y, int z)
+        {
+            const int mask = BrickSize - 1;
+            return this->Brick(x, y, z)[(x & mask) + ((y & mask) << BrickShift) + ((z & mask) << (2 * BrickShift))];
+        }
+        
+    private:
+        
+        // Enough for the corners of a cell on a brick corner, plus the brick the row carries on into
+        static const int NumberOfPins = 9;
+        
+        CompressedBrickVolume *Volume;
+        long long Keys[NumberOfPins];
+        CompressedBrickVolume::BrickPointer Pins[NumberOfPins];
+        int Next;
+    };
+    
+    // FixedPointResliceRowScalar, with the voxels coming from bricks
+    void CompressedResliceRow(BrickSampler &sampler, const int size[3], int x, int y, int z, int dx, int dy, int dz,
+                              short background, short *output, std::size_t count)
+    {
+        const int maximum[3] = { (size[0] - 1) << FixedPointShift, (size[1] - 1) << FixedPointShift, (size[2] - 1) << FixedPointShift };
+        const int fractionMask = (1 << FixedPointShift) - 1;
+        const int weightShift = FixedPointShift - FixedPointWeightBits;
+        const int rowStride = BrickSize;
+        const int sliceStride = BrickSize * BrickSize;
+        const int mask = BrickSize - 1;
+        
+        for (std::size_t i = 0; i < count; ++i, x += dx, y += dy, z += dz)
+        {
+            if (x < 0 || y < 0 || z < 0 || x > maximum[0] || y > maximum[1] || z > maximum[2])
+            {
+                output[i] = background;
+                continue;
+            }
+            
+            int ix = x >> FixedPointShift, wx = (x & fractionMask) >> weightShift;
+            int iy = y >> FixedPointShift, wy = (y & fractionMask) >> weightShift;
+            int iz = z >> FixedPointShift, wz = (z & fractionMask) >> weightShift;
+            if (ix == size[0] - 1) { --ix; wx = 1 << FixedPointWeightBits; }
+            if (iy == size[1] - 1) { --iy; wy = 1 << FixedPointWeightBits; }
+            if (iz == size[2] - 1) { --iz; wz = 1 << FixedPointWeightBits; }
+            
+            // Most cells are inside one brick; the ones on a brick's far faces fetch their corners one by one
+            short corners[8];
+            if ((ix & mask) != mask && (iy & mask) != mask && (iz & mask) != mask)
+            {
+                const short *p = sampler.Brick(ix, iy, iz) + (ix & mask) + (iy & mask) * rowStride + (iz & mask) * sliceStride;
+                corners[0] = p[0];
+                corners[1] = p[1];
+                corners[2] = p[rowStride];
+                corners[3] = p[rowStride + 1];
+                corners[4] = p[sliceStride];
+                corners[5] = p[sliceStride + 1];
+                corners[6] = p[rowStride + sliceStride];
+                corners[7] = p[rowStride + sliceStride + 1];
+            }
+            else
+            {
+                for (int c = 0; c < 8; ++c)
+                {
+                    corners[c] = sampler.Voxel(ix + (c & 1), iy + ((c >> 1) & 1), iz + ((c >> 2) & 1));
+                }
+            }
+            
+            const int c00 = FixedPointLerp(corners[0], corners[1], wx);
+            const int c10 = FixedPointLerp(corners[2], corners[3], wx);
+            const int c01 = FixedPointLerp(corners[4], corners[5], wx);
+            const int c11 = FixedPointLerp(corners[6], corners[7], wx);
+            output[i] = static_cast<short>(FixedPointLerp(FixedPointLerp(c00, c10, wy), FixedPointLerp(c01, c11, wy), wz));
+        }
+    }
+}
+
+vtkImageCompressedReslice::vtkImageCompressedReslice()
+{
+    this->CompressedVolume = 0;
+    this->SetOutputScalarType(VTK_SHORT);
+}
+
+void vtkImageCompressedReslice::SetCompressedVolume(CompressedBrickVolume *volume)
+{
+    if (this->CompressedVolume != volume)
+    {
+        this->CompressedVolume = volume;
+        this->Modified();
+    }
+}
+
+int vtkImageCompressedReslice::RequestData(vtkInformation *request, vtkInformationVector **inputVector, vtkInformationVector *outputVector)
+{
+    // Same limits as vtkImageFixedPointReslice, but there is nothing to fall back on
+    vtkImageData *input = vtkImageData::GetData(inputVector[0]);
+    int inExt[6];
+    if (input)
+    {
+        input->GetExtent(inExt);
+    }
+    this->UsedFixedPoint = input && this->CompressedVolume
+        && vtkImageData::GetScalarType(outputVector->GetInformationObject(0)) == VTK_SHORT
+        && this->GetInterpolationMode() == VTK_RESLICE_LINEAR && this->GetResliceTransform() == 0
+        && this->GetSlabNumberOfSlices() <= 1 && !this->GetWrap() && !this->GetMirror() && this->GetStencil() == 0
+        && ExtentFitsFixedPoint(inExt) && this->OutputFitsFixedPoint(input, outputVector->GetInformationObject(0));
+    if (!this->UsedFixedPoint)
+    {
+        vtkErrorMacro("Only linear reslicing of a compressed volume (of fewer than " << MaximumFixedPointExtent
+                      << " voxels a side, with the output within that many voxels of it) through the reslice axes is supported");
+    }
+    return this->vtkThreadedImageAlgorithm::RequestData(request, inputVector, outputVector);
+}
+
+void vtkImageCompressedReslice::ThreadedRequestData(vtkInformation *, vtkInformationVector **, vtkInformationVector *,
+                                                    vtkImageData ***inData, vtkImageData **outData, int outExt[6], int)
+{
+    if (!this->UsedFixedPoint)
+    {
+        return;
+    }
+    vtkImageData *input = inData[0][0];
+    vtkImageData *output = outData[0];
+    int inExt[6];
+    input->GetExtent(inExt);
+    
+    double toInput[3][4];
+    this->GetOutputIndexToInputIndex(input, output, toInput);
+    const int size[3] = { inExt[1] - inExt[0] + 1, inExt[3] - inExt[2] + 1, inExt[5] - inExt[4] + 1 };
+    
+    double background = this->GetBackgroundLevel();
+    background = background < VTK_SHORT_MIN ? VTK_SHORT_MIN : (background > VTK_SHORT_MAX ? VTK_SHORT_MAX : background);
+    
+    const int dx = ToFixedPoint(toInput[0][0]);
+    const int dy = ToFixedPoint(toInput[1][0]);
+    const int dz = ToFixedPoint(toInput[2][0]);
+    const std::size_t count = outExt[1] - outExt[0] + 1;
+    
+    BrickSampler sampler(this->CompressedVolume);
+    for (int k = outExt[4]; k <= outExt[5]; ++k)
+    {
+        for (int j = outExt[2]; j <= outExt[3]; ++j)
+        {
+            double start[3];
+            for (int r = 0; r < 3; ++r)
+            {
+                start[r] = toInput[r][0] * outExt[0] + toInput[r][1] * j + toInput[r][2] * k + toInput[r][3];
+            }
+            short *row = static_cast<short *>(output->GetScalarPointer(outExt[0], j, k));
+            CompressedResliceRow(sampler, size, ToFixedPoint(start[0]), ToFixedPoint(start[1]), ToFixedPoint(start[2]), dx, dy, dz,
+                                 static_cast<short>(background), row, count);
+        }
+    }
+}
@@ -0,0 +1,50 @@
+//
+//  vtkImageCompressedReslice.hpp
+//  ImageSlicing
+//
+//  Created by Tom on 23/09/2016.
+//
+//
+
+#ifndef vtkImageCompressedReslice_hpp
+#define vtkImageCompressedReslice_hpp
+
+#include "vtkImageFixedPointReslice.hpp"
+
+class CompressedBrickVolume;
+
+// Reslices a CompressedBrickVolume, decoding only the bricks the slice passes through (which its brick cache
+// then keeps for the next few slices). The input is the volume's GetGeometry(), which has no voxels of its own.
+// Same fixed point linear interpolation through the reslice axes as vtkImageFixedPointReslice, and since the
+// compression is lossless the same answers; other interpolation modes, transforms and stencils aren't supported.
+class vtkImageCompressedReslice : public vtkImageFixedPointReslice
+{
+public:
+    
+    static vtkImageCompressedReslice *New();
+    vtkTypeMacro(vtkImageCompressedReslice, vtkImageFixedPointReslice);
+    
+    // Not reference counted: it has to outlive this
+    void SetCompressedVolume(CompressedBrickVolume *volume);
+    CompressedBrickVolume *GetCompressedVolume() const { return this->CompressedVolume; }
+    
+protected:
+    
+    vtkImageCompressedReslice();
+    
+    // Checks (once, setting UsedFixedPoint) that the settings and extent are ones it can do, then straight to the
+    // threads, since there are no input voxels for vtkImageReslice to set its interpolator up with
+    virtual int RequestData(vtkInformation *request, vtkInformationVector **inputVector, vtkInformationVector *outputVector);
+    
+    virtual void ThreadedRequestData(vtkInformation *request, vtkInformationVector **inputVector, vtkInformationVector *outputVector,
+                                     vtkImageData ***inData, vtkImageData **outData, int outExt[6], int threadId);
+    
+    CompressedBrickVolume *CompressedVolume;
+    
+private:
+    
+    vtkImageCompressedReslice(const vtkImageCompressedReslice&);
+    void operator=(const vtkImageCompressedReslice&);
+};
+
+#endif /* vtkImageCompressedReslice_hpp */
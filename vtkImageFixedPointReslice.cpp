@@ -0,0 +1,201 @@
+//
+//  vtkImageFixedPointReslice.cpp
+//  ImageSlicing
+//
+//  Created by Tom on 07/09/2016.
+//
+//
+
+#include "vtkImageFixedPointReslice.hpp"
+
+#include "vtkImageData.h"
+#include "vtkInformation.h"
+#include "vtkInformationVector.h"
+#include "vtkMatrix4x4.h"
+#include "vtkObjectFactory.h"
+#include "vtkStreamingDemandDrivenPipeline.h"
+
+#include "FixedPointResliceKernel.h"
+
+#include <cmath>
+
+vtkStandardNewMacro(vtkImageFixedPointReslice);
+
+const int vtkImageFixedPointReslice::MaximumFixedPointExtent;
+
+// Clamping keeps the steps along a row from overflowing; RequestData only takes the fast path when nothing is
+// this far out (see OutputFitsFixedPoint), since clamping one end of a row would shift the rest of it
+int vtkImageFixedPointReslice::ToFixedPoint(double value)
+{
+    static_assert(MaximumFixedPointExtent <= 1 << (29 - FixedPointShift), "The clamp needs room for a step of the same size");
+    const double limit = MaximumFixedPointExtent << FixedPointShift;
+    const double fixed = std::floor(value * (1 << FixedPointShift) + 0.5);
+    return static_cast<int>(fixed < -limit ? -limit : (fixed > limit ? limit : fixed));
+}
+
+vtkImageFixedPointReslice::vtkImageFixedPointReslice()
+{
+    this->UsedFixedPoint = 0;
+}
+
+bool vtkImageFixedPointReslice::ExtentFitsFixedPoint(const int inExt[6])
+{
+    for (int i = 0; i < 3; ++i)
+    {
+        const int size = inExt[2 * i + 1] - inExt[2 * i] + 1;
+        if (size < 2 || size >= MaximumFixedPointExtent)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool vtkImageFixedPointReslice::CanUseFixedPoint(vtkImageData *input, int outputScalarType)
+{
+    int inExt[6];
+    input->GetExtent(inExt);
+    
+    return input->GetScalarType() == VTK_SHORT && outputScalarType == VTK_SHORT
+        && input->GetNumberOfScalarComponents() == 1
+        && this->GetInterpolationMode() == VTK_RESLICE_LINEAR
+        && this->GetResliceTransform() == 0
+        && this->GetSlabNumberOfSlices() <= 1
+        && !this->GetWrap() && !this->GetMirror()
+        && !this->GetGenerateStencilOutput() && this->GetStencil() == 0
+        && ExtentFitsFixedPoint(inExt);
+}
+
+int vtkImageFixedPointReslice::RequestData(vtkInformation *request, vtkInformationVector **inputVector, vtkInformationVector *outputVector)
+{
+    vtkImageData *input = vtkImageData::GetData(inputVector[0]);
+    const int outputScalarType = vtkImageData::GetScalarType(outputVector->GetInformationObject(0));
+    this->UsedFixedPoint = (input && this->CanUseFixedPoint(input, outputScalarType)
+                            && this->OutputFitsFixedPoint(input, outputVector->GetInformationObject(0))) ? 1 : 0;
+    return this->Superclass::RequestData(request, inputVector, outputVector);
+}
+
+void vtkImageFixedPointReslice::ThreadedRequestData(vtkInformation *request, vtkInformationVector **inputVector, vtkInformationVector *outputVector,
+                                                    vtkImageData ***inData, vtkImageData **outData, int outExt[6], int threadId)
+{
+    if (!this->UsedFixedPoint)
+    {
+        this->Superclass::ThreadedRequestData(request, inputVector, outputVector, inData, outData, outExt, threadId);
+        return;
+    }
+    vtkImageData *input = inData[0][0];
+    vtkImageData *output = outData[0];
+    
+    double toInput[3][4];
+    this->GetOutputIndexToInputIndex(input, output, toInput);
+    
+    int inExt[6];
+    input->GetExtent(inExt);
+    vtkIdType inIncrements[3];
+    input->GetIncrements(inIncrements);
+    const short *volume = static_cast<const short *>(input->GetScalarPointer(inExt[0], inExt[2], inExt[4]));
+    const int size[3] = { inExt[1] - inExt[0] + 1, inExt[3] - inExt[2] + 1, inExt[5] - inExt[4] + 1 };
+    
+    double background = this->GetBackgroundLevel();
+    background = background < VTK_SHORT_MIN ? VTK_SHORT_MIN : (background > VTK_SHORT_MAX ? VTK_SHORT_MAX : background);
+    
+    // Stepping along a row is the same everywhere
+    const int dx = ToFixedPoint(toInput[0][0]);
+    const int dy = ToFixedPoint(toInput[1][0]);
+    const int dz = ToFixedPoint(toInput[2][0]);
+    const std::size_t count = outExt[1] - outExt[0] + 1;
+    
+    for (int k = outExt[4]; k <= outExt[5]; ++k)
+    {
+        for (int j = outExt[2]; j <= outExt[3]; ++j)
+        {
+            double start[3];
+            for (int r = 0; r < 3; ++r)
+            {
+                start[r] = toInput[r][0] * outExt[0] + toInput[r][1] * j + toInput[r][2] * k + toInput[r][3];
+            }
+            short *row = static_cast<short *>(output->GetScalarPointer(outExt[0], j, k));
+            FixedPointResliceRow(volume, size, inIncrements[1], inIncrements[2],
+                                 ToFixedPoint(start[0]), ToFixedPoint(start[1]), ToFixedPoint(start[2]), dx, dy, dz,
+                                 static_cast<short>(background), row, count);
+        }
+    }
+}
+
+bool vtkImageFixedPointReslice::OutputFitsFixedPoint(vtkImageData *input, vtkInformation *outInfo)
+{
+    // The output data object hasn't been given its geometry yet, so it comes from the pipeline information
+    double outOrigin[3], outSpacing[3];
+    int outExt[6];
+    outInfo->Get(vtkDataObject::ORIGIN(), outOrigin);
+    outInfo->Get(vtkDataObject::SPACING(), outSpacing);
+    outInfo->Get(vtkStreamingDemandDrivenPipeline::UPDATE_EXTENT(), outExt);
+    
+    double toInput[3][4];
+    this->GetOutputIndexToInputIndex(input, outOrigin, outSpacing, toInput);
+    
+    const double limit = MaximumFixedPointExtent;
+    for (int r = 0; r < 3; ++r)
+    {
+        if (std::fabs(toInput[r][0]) >= limit)
+        {
+            return false;
+        }
+        for (int corner = 0; corner < 8; ++corner)
+        {
+            const double index = toInput[r][0] * outExt[corner & 1] + toInput[r][1] * outExt[2 + ((corner >> 1) & 1)]
+                               + toInput[r][2] * outExt[4 + ((corner >> 2) & 1)] + toInput[r][3];
+            if (std::fabs(index) >= limit)
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void vtkImageFixedPointReslice::GetOutputIndexToInputIndex(vtkImageData *input, vtkImageData *output, double toInput[3][4])
+{
+    double outOrigin[3], outSpacing[3];
+    output->GetOrigin(outOrigin);
+    output->GetSpacing(outSpacing);
+    this->GetOutputIndexToInputIndex(input, outOrigin, outSpacing, toInput);
+}
+
+void vtkImageFixedPointReslice::GetOutputIndexToInputIndex(vtkImageData *input, const double outOrigin[3], const double outSpacing[3],
+                                                           double toInput[3][4])
+{
+    // Output index -> output coordinates -> (reslice axes) -> world -> input continuous index, as one matrix
+    double inOrigin[3], inSpacing[3];
+    int inExt[6];
+    input->GetOrigin(inOrigin);
+    input->GetSpacing(inSpacing);
+    input->GetExtent(inExt);
+    
+    double outIndexToAxes[4][4] = {
+        { outSpacing[0], 0, 0, outOrigin[0] },
+        { 0, outSpacing[1], 0, outOrigin[1] },
+        { 0, 0, outSpacing[2], outOrigin[2] },
+        { 0, 0, 0, 1 } };
+    double axes[4][4];
+    vtkMatrix4x4 *resliceAxes = this->GetResliceAxes();
+    for (int r = 0; r < 4; ++r)
+    {
+        for (int c = 0; c < 4; ++c)
+        {
+            axes[r][c] = resliceAxes ? resliceAxes->GetElement(r, c) : (r == c ? 1.0 : 0.0);
+        }
+    }
+    double outIndexToWorld[4][4];
+    vtkMatrix4x4::Multiply4x4(&axes[0][0], &outIndexToAxes[0][0], &outIndexToWorld[0][0]);
+    
+    // Rows of the index matrix, relative to the first voxel actually in the input buffer
+    for (int r = 0; r < 3; ++r)
+    {
+        for (int c = 0; c < 4; ++c)
+        {
+            toInput[r][c] = outIndexToWorld[r][c] / inSpacing[r];
+        }
+        toInput[r][3] -= inOrigin[r] / inSpacing[r] + inExt[2 * r];
+    }
+}
@@ -0,0 +1,73 @@
+//
+//  vtkImageFixedPointReslice.hpp
+//  ImageSlicing
+//
+//  Created by Tom on 07/09/2016.
+//
+//
+
+#ifndef vtkImageFixedPointReslice_hpp
+#define vtkImageFixedPointReslice_hpp
+
+#include "vtkImageReslice.h"
+
+// vtkImageReslice with a fast path for the case we use all the time: signed short, one component, linear
+// interpolation through a plain reslice axes matrix (any orientation, so oblique views too). Each output row
+// is a straight line through the input, so it is walked with 16.16 fixed point steps and interpolated with
+// integer weights (see FixedPointResliceKernel.h), rather than transforming every point in double precision.
+// Results are within a few units of the standard path. Anything else goes to vtkImageReslice as usual.
+class vtkImageFixedPointReslice : public vtkImageReslice
+{
+public:
+    
+    static vtkImageFixedPointReslice *New();
+    vtkTypeMacro(vtkImageFixedPointReslice, vtkImageReslice);
+    
+    // Whether the last update took the fast path
+    vtkGetMacro(UsedFixedPoint, int);
+    
+    // Inputs must be smaller than this (in voxels) along every axis for the fast path, and every output voxel
+    // (and the step along a row) must land within this many voxels of the input, so nothing is clamped by
+    // ToFixedPoint
+    static const int MaximumFixedPointExtent = 8192;
+    
+protected:
+    
+    vtkImageFixedPointReslice();
+    
+    // Decides on the fast path (sets UsedFixedPoint) once, before the threads start
+    virtual int RequestData(vtkInformation *request, vtkInformationVector **inputVector, vtkInformationVector *outputVector);
+    
+    virtual void ThreadedRequestData(vtkInformation *request, vtkInformationVector **inputVector, vtkInformationVector *outputVector,
+                                     vtkImageData ***inData, vtkImageData **outData, int outExt[6], int threadId);
+    
+    // Can this input, output scalar type and these settings go through the fast path?
+    bool CanUseFixedPoint(vtkImageData *input, int outputScalarType);
+    
+    // At least two voxels (for the kernel) and fewer than MaximumFixedPointExtent along every axis
+    static bool ExtentFitsFixedPoint(const int inExt[6]);
+    
+    // Whether the corners of the output update extent (and so, rows being straight, every output voxel) and the
+    // step along a row are all within MaximumFixedPointExtent voxels of the input. An oblique row can start well
+    // off the volume and still cross it, and clamping its start would shift the whole row.
+    bool OutputFitsFixedPoint(vtkImageData *input, vtkInformation *outInfo);
+    
+    // Rows of the matrix taking an output index to a continuous index into the input, counted from the first
+    // voxel of the input extent
+    void GetOutputIndexToInputIndex(vtkImageData *input, vtkImageData *output, double toInput[3][4]);
+    void GetOutputIndexToInputIndex(vtkImageData *input, const double outOrigin[3], const double outSpacing[3], double toInput[3][4]);
+    
+    // 16.16, clamped to +/- MaximumFixedPointExtent voxels so the steps along a row can't overflow. Only hit by
+    // outputs that OutputFitsFixedPoint turns away.
+    static int ToFixedPoint(double value);
+    
+    // Only written by RequestData, so the threads all read the same answer
+    int UsedFixedPoint;
+    
+private:
+    
+    vtkImageFixedPointReslice(const vtkImageFixedPointReslice&);
+    void operator=(const vtkImageFixedPointReslice&);
+};
+
+#endif /* vtkImageFixedPointReslice_hpp */
@@ -12,6 +12,13 @@
 #include "vtkInteractorStyleImage.h"
 #include "vtkImageData.h"
 
+#include "vtkImageSlabProjection.hpp"
+#include "SliceCache.h"
+#include "CinePlayer.h"
+
+#include <chrono>
+#include <string>
+
 vtkImageInteractionCallback *vtkImageInteractionCallback::New()
 {
     return new vtkImageInteractionCallback;
@@ -20,7 +27,20 @@ vtkImageInteractionCallback *vtkImageInteractionCallback::New()
 vtkImageInteractionCallback::vtkImageInteractionCallback()
 {
     this->Slicing = 0;
+    this->SliceSpacing = 1.0;
+    this->SliceSpacingInput = 0;
+    this->SliceSpacingTime = 0;
+    this->StyleObserver = 0;
+    this->Style = 0;
+    this->NumberOfTimedEvents = 0;
+    this->TotalEventLatency = 0.0;
+    this->MaximumEventLatency = 0.0;
     this->ImageReslice = 0;
+    this->Colors = 0;
+    this->DisplayImage = 0;
+    this->SlabProjection = 0;
+    this->Cache = 0;
+    this->Cine = 0;
     this->Interactor = 0;
 };
 
@@ -40,23 +60,211 @@ vtkImageMapToColors *vtkImageInteractionCallback::GetImageColors()
     return this->Colors;
 }
 
+void vtkImageInteractionCallback::SetDisplayImage(vtkImageData *image)
+{
+    this->DisplayImage = image;
+}
+
+vtkImageData *vtkImageInteractionCallback::GetDisplayImage()
+{
+    return this->DisplayImage;
+}
+
+void vtkImageInteractionCallback::SetSlabProjection(vtkImageSlabProjection *projection)
+{
+    this->SlabProjection = projection;
+}
+
+vtkImageSlabProjection *vtkImageInteractionCallback::GetSlabProjection()
+{
+    return this->SlabProjection;
+}
+
+void vtkImageInteractionCallback::SetSliceCache(SliceCache *cache)
+{
+    this->Cache = cache;
+}
+
+SliceCache *vtkImageInteractionCallback::GetSliceCache()
+{
+    return this->Cache;
+}
+
+void vtkImageInteractionCallback::SetCinePlayer(CinePlayer *player)
+{
+    this->Cine = player;
+}
+
+CinePlayer *vtkImageInteractionCallback::GetCinePlayer()
+{
+    return this->Cine;
+}
+
 void vtkImageInteractionCallback::SetInteractor(vtkRenderWindowInteractor *interactor) {
     this->Interactor = interactor; };
 
 vtkRenderWindowInteractor *vtkImageInteractionCallback::GetInteractor() {
     return this->Interactor; };
 
-void vtkImageInteractionCallback::Execute(vtkObject *, unsigned long event, void *)
+void vtkImageInteractionCallback::ResetEventLatency()
+{
+    this->NumberOfTimedEvents = 0;
+    this->TotalEventLatency = 0.0;
+    this->MaximumEventLatency = 0.0;
+}
+
+void vtkImageInteractionCallback::Execute(vtkObject *, unsigned long event, void *callData)
+{
+    if (event == vtkCommand::TimerEvent)
+    {
+        this->HandleEvent(event, callData);
+        return;
+    }
+    
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    this->HandleEvent(event, callData);
+    const double latency = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    ++this->NumberOfTimedEvents;
+    this->TotalEventLatency += latency;
+    if (latency > this->MaximumEventLatency)
+    {
+        this->MaximumEventLatency = latency;
+    }
+}
+
+double vtkImageInteractionCallback::GetSliceSpacing()
+{
+    vtkImageReslice *reslice = this->ImageReslice;
+    vtkObject *input = reslice->GetInput();
+    const unsigned long inputTime = input ? input->GetMTime() : 0;
+    if (input != this->SliceSpacingInput || inputTime != this->SliceSpacingTime)
+    {
+        reslice->UpdateInformation();
+        this->SliceSpacing = reslice->GetOutput()->GetSpacing()[2];
+        this->SliceSpacingInput = input;
+        this->SliceSpacingTime = inputTime;
+    }
+    return this->SliceSpacing;
+}
+
+void vtkImageInteractionCallback::StepSlice(int steps)
+{
+    vtkImageReslice *reslice = this->ImageReslice;
+    vtkMatrix4x4 *matrix = reslice->GetResliceAxes();
+    // move the center point that we are slicing through
+    double point[4];
+    double center[4];
+    point[0] = 0.0;
+    point[1] = 0.0;
+    point[2] = this->GetSliceSpacing() * steps;
+    point[3] = 1.0;
+    matrix->MultiplyPoint(point, center);
+    matrix->SetElement(0, 3, center[0]);
+    matrix->SetElement(1, 3, center[1]);
+    matrix->SetElement(2, 3, center[2]);
+    
+    vtkSmartPointer<vtkImageData> cached;
+    if (this->Cache)
+    {
+        cached = this->Cache->Find(SliceCache::Key(matrix, reslice, this->SlabProjection, this->Colors));
+    }
+    if (cached)
+    {
+        // Been here before, so it's just a new texture for the actor
+        this->ShowImage(cached);
+    }
+    else
+    {
+        reslice->Update();
+        if (this->SlabProjection)
+        {
+            this->SlabProjection->Update();
+        }
+        this->Colors->Update(); /// WHY DO WE HAVE TO DO THIS MANUALLY???????
+        if (this->Cache)
+        {
+            this->Cache->Insert(SliceCache::Key(matrix, reslice, this->SlabProjection, this->Colors), this->Colors->GetOutput());
+        }
+        this->ShowImage(this->Colors->GetOutput());
+    }
+    if (this->Cache && steps != 0)
+    {
+        this->Cache->Prefetch(reslice, this->SlabProjection, this->Colors, steps > 0 ? 1 : -1);
+    }
+    this->Interactor->Render();
+}
+
+void vtkImageInteractionCallback::ShowImage(vtkImageData *image)
+{
+    this->DisplayImage->ShallowCopy(image);
+    this->DisplayImage->Modified();
+}
+
+void vtkImageInteractionCallback::HandleEvent(unsigned long event, void *callData)
 {
     vtkRenderWindowInteractor *interactor = this->GetInteractor();
     
-    int lastPos[2];
-    interactor->GetLastEventPosition(lastPos);
-    int currPos[2];
-    interactor->GetEventPosition(currPos);
+    // By far the most common: the mouse moving while not slicing, which just goes on to the style
+    if (event == vtkCommand::MouseMoveEvent && !this->Slicing)
+    {
+        vtkInteractorObserver *observer = interactor->GetInteractorStyle();
+        if (observer != this->StyleObserver)
+        {
+            this->StyleObserver = observer;
+            this->Style = vtkInteractorStyle::SafeDownCast(observer);
+        }
+        if (this->Style)
+        {
+            this->Style->OnMouseMove();
+        }
+        return;
+    }
     
-    if (event == vtkCommand::LeftButtonPressEvent)
+    if (event == vtkCommand::TimerEvent)
+    {
+        if (this->Cine && callData)
+        {
+            this->Cine->OnTimer(*static_cast<int *>(callData));
+        }
+    }
+    else if (event == vtkCommand::KeyPressEvent)
     {
+        const std::string key = interactor->GetKeySym() ? interactor->GetKeySym() : "";
+        if (key == "Prior" || key == "Next")
+        {
+            if (this->Cine && this->Cine->IsPlaying())
+            {
+                this->Cine->Stop();
+            }
+            this->StepSlice(key == "Prior" ? 1 : -1);
+        }
+        else if (this->Cine && key == "c")
+        {
+            if (this->Cine->IsPlaying())
+            {
+                this->Cine->Stop();
+            }
+            else
+            {
+                this->Cine->Start(this->ImageReslice, this->SlabProjection, this->Colors, this->DisplayImage, interactor);
+            }
+        }
+        else if (this->Cine && (key == "plus" || key == "equal" || key == "KP_Add"))
+        {
+            this->Cine->SetFrameRate(this->Cine->GetFrameRate() + 5.0);
+        }
+        else if (this->Cine && (key == "minus" || key == "KP_Subtract"))
+        {
+            this->Cine->SetFrameRate(this->Cine->GetFrameRate() - 5.0);
+        }
+    }
+    else if (event == vtkCommand::LeftButtonPressEvent)
+    {
+        // Grabbing the slice stops playback where it is
+        if (this->Cine && this->Cine->IsPlaying())
+        {
+            this->Cine->Stop();
+        }
         this->Slicing = 1;
     }
     else if (event == vtkCommand::LeftButtonReleaseEvent)
@@ -65,38 +273,15 @@ void vtkImageInteractionCallback::Execute(vtkObject *, unsigned long event, void
     }
     else if (event == vtkCommand::MouseMoveEvent)
     {
-        if (this->Slicing)
-        {
-            vtkImageReslice *reslice = this->ImageReslice;
-            
-            // Increment slice position by deltaY of mouse
-            int deltaY = lastPos[1] - currPos[1];
-            
-            reslice->UpdateInformation();
-            double sliceSpacing = reslice->GetOutput()->GetSpacing()[2];
-            vtkMatrix4x4 *matrix = reslice->GetResliceAxes();
-            // move the center point that we are slicing through
-            double point[4];
-            double center[4];
-            point[0] = 0.0;
-            point[1] = 0.0;
-            point[2] = sliceSpacing * deltaY;
-            point[3] = 1.0;
-            matrix->MultiplyPoint(point, center);
-            matrix->SetElement(0, 3, center[0]);
-            matrix->SetElement(1, 3, center[1]);
-            matrix->SetElement(2, 3, center[2]);
-            reslice->Update();
-            this->Colors->Update(); /// WHY DO WE HAVE TO DO THIS MANUALLY???????
-            interactor->Render();
-        }
-        else
+        // Increment slice position by deltaY of mouse
+        int lastPos[2];
+        interactor->GetLastEventPosition(lastPos);
+        int currPos[2];
+        interactor->GetEventPosition(currPos);
+        // Sideways moves don't change the slice, so there's nothing to redraw
+        if (lastPos[1] != currPos[1])
         {
-            vtkInteractorStyle *style = vtkInteractorStyle::SafeDownCast(interactor->GetInteractorStyle());
-            if (style)
-            {
-                style->OnMouseMove();
-            }
+            this->StepSlice(lastPos[1] - currPos[1]);
         }
     }
 };
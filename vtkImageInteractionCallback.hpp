@@ -14,7 +14,16 @@
 #include "vtkRenderWindowInteractor.h"
 #include "vtkImageMapToColors.h"
 
-// The mouse motion callback, to turn "Slicing" on and off
+#include <cstddef>
+
+class vtkImageData;
+class vtkImageSlabProjection;
+class vtkInteractorObserver;
+class vtkInteractorStyle;
+class SliceCache;
+class CinePlayer;
+
+// The mouse motion callback, to turn "Slicing" on and off. Page Up and Page Down step one slice as well.
 class vtkImageInteractionCallback : public vtkCommand
 {
 public:
@@ -30,6 +39,28 @@ public:
     void SetImageColors(vtkImageMapToColors *color) ;
     
     vtkImageMapToColors *GetImageColors();
+    
+    // The image the actor shows. Freshly made slices (the colours' output) and cached ones are both shallow
+    // copied into it, so nothing ever writes into a pipeline's output behind its back.
+    void SetDisplayImage(vtkImageData *image);
+    
+    vtkImageData *GetDisplayImage();
+    
+    // For thick-slab viewing, the projection between the reslice and the colours
+    void SetSlabProjection(vtkImageSlabProjection *projection);
+    
+    vtkImageSlabProjection *GetSlabProjection();
+    
+    // Optional: reuse finished slices from (and prefetch ahead into) the cache instead of reslicing each time
+    void SetSliceCache(SliceCache *cache);
+    
+    SliceCache *GetSliceCache();
+    
+    // Optional: 'c' starts and stops cine playback, '+' and '-' change its frame rate. Also needs the callback
+    // observing the interactor's TimerEvent and the style's KeyPressEvent.
+    void SetCinePlayer(CinePlayer *player);
+    
+    CinePlayer *GetCinePlayer();
 
     void SetInteractor(vtkRenderWindowInteractor *interactor);
     
@@ -37,15 +68,54 @@ public:
     
     virtual void Execute(vtkObject *, unsigned long event, void *);
     
+    // Time spent in Execute, in microseconds, over the events since the last reset (not counting timer events,
+    // which are cine frames)
+    std::size_t GetNumberOfTimedEvents() const { return this->NumberOfTimedEvents; }
+    double GetMeanEventLatency() const { return this->NumberOfTimedEvents ? this->TotalEventLatency / this->NumberOfTimedEvents : 0.0; }
+    double GetMaximumEventLatency() const { return this->MaximumEventLatency; }
+    void ResetEventLatency();
+    
 private:
     
+    void HandleEvent(unsigned long event, void *callData);
+    
+    // Move the slice along its normal by this many slices, and show it
+    void StepSlice(int steps);
+    
+    // Point the display image at this one
+    void ShowImage(vtkImageData *image);
+    
+    // The distance between slices, worked out again only when the reslice's input has changed
+    double GetSliceSpacing();
+    
     // Actions (slicing only, for now)
     int Slicing;
     
+    // Slice geometry, and the input (and its modified time) it was worked out for
+    double SliceSpacing;
+    vtkObject *SliceSpacingInput;
+    unsigned long SliceSpacingTime;
+    
+    // The interactor's style when we last looked, so that mouse moves we don't want go straight to it
+    vtkInteractorObserver *StyleObserver;
+    vtkInteractorStyle *Style;
+    
+    std::size_t NumberOfTimedEvents;
+    double TotalEventLatency;
+    double MaximumEventLatency;
+    
     // Pointer to vtkImageReslice
     vtkImageReslice *ImageReslice;
     
     vtkImageMapToColors *Colors;
+    
+    vtkImageData *DisplayImage;
+    
+    vtkImageSlabProjection *SlabProjection;
+    
+    SliceCache *Cache;
+    
+    CinePlayer *Cine;
 
     // Pointer to the interactor
     vtkRenderWindowInteractor *Interactor;
@@ -0,0 +1,133 @@
+//
+//  vtkImageSlabProjection.cpp
+//  ImageSlicing
+//
+//  Created by Tom on 05/09/2016.
+//
+//
+
+#include "vtkImageSlabProjection.hpp"
+
+#include "vtkImageData.h"
+#include "vtkImageReslice.h"
+#include "vtkInformation.h"
+#include "vtkInformationVector.h"
+#include "vtkObjectFactory.h"
+#include "vtkStreamingDemandDrivenPipeline.h"
+
+#include <algorithm>
+#include <cmath>
+
+vtkStandardNewMacro(vtkImageSlabProjection);
+
+namespace
+{
+    template< typename T >
+    void vtkImageSlabProjectionExecute(vtkImageData *input, vtkImageData *output, int outExt[6], int inZ[2],
+                                       SlabProjectionMode mode)
+    {
+        vtkIdType inIncrements[3];
+        input->GetIncrements(inIncrements);
+        const int numberOfSlices = inZ[1] - inZ[0] + 1;
+        // Components are interleaved, and the projection is per value, so a row is just longer
+        const std::size_t count = static_cast<std::size_t>(outExt[1] - outExt[0] + 1) * input->GetNumberOfScalarComponents();
+        
+        for (int j = outExt[2]; j <= outExt[3]; ++j)
+        {
+            const T *first = static_cast<const T *>(input->GetScalarPointer(outExt[0], j, inZ[0]));
+            T *row = static_cast<T *>(output->GetScalarPointer(outExt[0], j, outExt[4]));
+            SlabProjectRow(first, static_cast<std::ptrdiff_t>(inIncrements[2]), numberOfSlices, mode, row, count);
+        }
+    }
+}
+
+vtkImageSlabProjection::vtkImageSlabProjection()
+{
+    this->Mode = SlabProjectionMaximum;
+}
+
+void vtkImageSlabProjection::ConfigureSlabReslice(vtkImageReslice *reslice, double thickness)
+{
+    // Find out what a single slice would look like
+    reslice->SetOutputDimensionality(2);
+    reslice->SetOutputExtentToDefault();
+    reslice->SetOutputSpacingToDefault();
+    reslice->SetOutputOriginToDefault();
+    reslice->UpdateInformation();
+    
+    vtkInformation *outInfo = reslice->GetOutputInformation(0);
+    int extent[6];
+    double spacing[3];
+    double origin[3];
+    outInfo->Get(vtkStreamingDemandDrivenPipeline::WHOLE_EXTENT(), extent);
+    outInfo->Get(vtkDataObject::SPACING(), spacing);
+    outInfo->Get(vtkDataObject::ORIGIN(), origin);
+    
+    // Then stack enough of them either side of the centre to cover the thickness
+    const int halfSlices = std::max(0, static_cast<int>(std::floor(0.5 * thickness / spacing[2] + 0.5)));
+    reslice->SetOutputDimensionality(3);
+    reslice->SetOutputExtent(extent[0], extent[1], extent[2], extent[3], -halfSlices, halfSlices);
+    reslice->SetOutputSpacing(spacing[0], spacing[1], spacing[2]);
+    reslice->SetOutputOrigin(origin[0], origin[1], 0.0);
+}
+
+int vtkImageSlabProjection::RequestInformation(vtkInformation *, vtkInformationVector **inputVector, vtkInformationVector *outputVector)
+{
+    vtkInformation *inInfo = inputVector[0]->GetInformationObject(0);
+    vtkInformation *outInfo = outputVector->GetInformationObject(0);
+    
+    // Same in-plane extent, spacing and origin, one slice at the slab centre
+    int extent[6];
+    inInfo->Get(vtkStreamingDemandDrivenPipeline::WHOLE_EXTENT(), extent);
+    extent[4] = extent[5] = 0;
+    outInfo->Set(vtkStreamingDemandDrivenPipeline::WHOLE_EXTENT(), extent, 6);
+    
+    double origin[3];
+    inInfo->Get(vtkDataObject::ORIGIN(), origin);
+    origin[2] = 0.0;
+    outInfo->Set(vtkDataObject::ORIGIN(), origin, 3);
+    
+    return 1;
+}
+
+int vtkImageSlabProjection::RequestUpdateExtent(vtkInformation *, vtkInformationVector **inputVector, vtkInformationVector *outputVector)
+{
+    vtkInformation *inInfo = inputVector[0]->GetInformationObject(0);
+    vtkInformation *outInfo = outputVector->GetInformationObject(0);
+    
+    // The rows we're asked for, through the whole slab
+    int updateExtent[6];
+    int wholeExtent[6];
+    outInfo->Get(vtkStreamingDemandDrivenPipeline::UPDATE_EXTENT(), updateExtent);
+    inInfo->Get(vtkStreamingDemandDrivenPipeline::WHOLE_EXTENT(), wholeExtent);
+    updateExtent[4] = wholeExtent[4];
+    updateExtent[5] = wholeExtent[5];
+    inInfo->Set(vtkStreamingDemandDrivenPipeline::UPDATE_EXTENT(), updateExtent, 6);
+    
+    return 1;
+}
+
+void vtkImageSlabProjection::ThreadedRequestData(vtkInformation *, vtkInformationVector **, vtkInformationVector *,
+                                                 vtkImageData ***inData, vtkImageData **outData, int outExt[6], int)
+{
+    vtkImageData *input = inData[0][0];
+    vtkImageData *output = outData[0];
+    
+    int inExt[6];
+    input->GetExtent(inExt);
+    int inZ[2] = { inExt[4], inExt[5] };
+    
+    if (input->GetScalarType() != output->GetScalarType())
+    {
+        vtkErrorMacro("Input and output scalar types differ");
+        return;
+    }
+    
+    switch (input->GetScalarType())
+    {
+        vtkTemplateMacro(vtkImageSlabProjectionExecute<VTK_TT>(input, output, outExt, inZ,
+                                                              static_cast<SlabProjectionMode>(this->Mode)));
+        default:
+            vtkErrorMacro("Unknown scalar type");
+    }
+}
@@ -0,0 +1,55 @@
+//
+//  vtkImageSlabProjection.hpp
+//  ImageSlicing
+//
+//  Created by Tom on 05/09/2016.
+//
+//
+
+#ifndef vtkImageSlabProjection_hpp
+#define vtkImageSlabProjection_hpp
+
+#include "vtkThreadedImageAlgorithm.h"
+
+#include "SlabProjectionKernel.h"
+
+class vtkImageReslice;
+
+// Collapses a stack of slices (a vtkImageReslice output set up with ConfigureSlabReslice) down to one image
+// by taking the maximum, minimum or mean along Z, using the SSE2 kernel for signed short
+class vtkImageSlabProjection : public vtkThreadedImageAlgorithm
+{
+public:
+    
+    static vtkImageSlabProjection *New();
+    vtkTypeMacro(vtkImageSlabProjection, vtkThreadedImageAlgorithm);
+    
+    vtkSetClampMacro(Mode, int, SlabProjectionMaximum, SlabProjectionMean);
+    vtkGetMacro(Mode, int);
+    void SetModeToMaximum() { this->SetMode(SlabProjectionMaximum); }
+    void SetModeToMinimum() { this->SetMode(SlabProjectionMinimum); }
+    void SetModeToMean() { this->SetMode(SlabProjectionMean); }
+    
+    // Make the reslice produce the slab of thickness (in world units) centred on its reslice axes, one slice
+    // per output Z spacing, instead of a single slice. The in-plane extent and spacing are what it would have
+    // used for a single slice. Needs its input and axes set, and calling again if the orientation changes.
+    static void ConfigureSlabReslice(vtkImageReslice *reslice, double thickness);
+    
+protected:
+    
+    vtkImageSlabProjection();
+    
+    virtual int RequestInformation(vtkInformation *, vtkInformationVector **, vtkInformationVector *);
+    virtual int RequestUpdateExtent(vtkInformation *, vtkInformationVector **, vtkInformationVector *);
+    virtual void ThreadedRequestData(vtkInformation *, vtkInformationVector **, vtkInformationVector *,
+                                     vtkImageData ***inData, vtkImageData **outData, int outExt[6], int threadId);
+    
+    int Mode;
+    
+private:
+    
+    vtkImageSlabProjection(const vtkImageSlabProjection&);
+    void operator=(const vtkImageSlabProjection&);
+};
+
+#endif /* vtkImageSlabProjection_hpp */
@@ -0,0 +1,104 @@
+//
+//  vtkPooledImageFilters.cpp
+//  ImageSlicing
+//
+//  Created by Tom on 27/08/2016.
+//
+//
+
+#include "vtkPooledImageFilters.hpp"
+
+#include "vtkCallbackCommand.h"
+#include "vtkImageData.h"
+#include "vtkObjectFactory.h"
+#include "vtkPointData.h"
+
+#include "VolumeBufferPool.h"
+
+#include <algorithm>
+
+vtkStandardNewMacro(vtkPooledImageReslice);
+vtkStandardNewMacro(vtkPooledImageMapToColors);
+
+namespace
+{
+    struct PooledArrayMemory
+    {
+        VolumeBufferPool* Pool;
+        void* Buffer;
+        std::size_t Bytes;
+    };
+    
+    void ReleasePooledArrayMemory( vtkObject*, unsigned long, void* clientData, void* )
+    {
+        PooledArrayMemory* memory = static_cast< PooledArrayMemory* >( clientData );
+        memory->Pool->Release( memory->Buffer, memory->Bytes );
+        delete memory;
+    }
+    
+    // A new array whose memory comes from the pool, and goes back to it when the array is deleted
+    vtkDataArray* NewPooledArray( int type, int components, vtkIdType tuples )
+    {
+        vtkDataArray* array = vtkDataArray::CreateDataArray( type );
+        array->SetNumberOfComponents( components );
+        const vtkIdType values = tuples * components;
+        if ( values == 0 )
+        {
+            return array;
+        }
+        
+        PooledArrayMemory* memory = new PooledArrayMemory;
+        memory->Pool = &VolumeBufferPool::GetGlobalPool();
+        memory->Bytes = static_cast< std::size_t >( values ) * array->GetDataTypeSize();
+        memory->Buffer = memory->Pool->Acquire( memory->Bytes );
+        
+        // save = 1 so that VTK never frees it itself
+        array->SetVoidArray( memory->Buffer, values, 1 );
+        
+        vtkSmartPointer< vtkCallbackCommand > release = vtkSmartPointer< vtkCallbackCommand >::New();
+        release->SetCallback( ReleasePooledArrayMemory );
+        release->SetClientData( memory );
+        array->AddObserver( vtkCommand::DeleteEvent, release );
+        return array;
+    }
+    
+    // What vtkImageAlgorithm::AllocateOutputData does, but reusing spare if we can
+    void AllocatePooledOutputData( vtkSmartPointer< vtkDataArray >& spare, vtkImageData* out, vtkInformation* outInfo, int* uExtent )
+    {
+        out->SetExtent( uExtent );
+        
+        const int type = vtkImageData::GetScalarType( outInfo );
+        const int components = vtkImageData::GetNumberOfScalarComponents( outInfo );
+        vtkIdType tuples = 1;
+        for ( int axis = 0; axis < 3; ++axis )
+        {
+            tuples *= std::max( 0, uExtent[2 * axis + 1] - uExtent[2 * axis] + 1 );
+        }
+        
+        // Drop the output's own reference to last time's scalars (the executive has normally done this
+        // already), so that the only one left is ours unless someone downstream has kept hold of them
+        out->GetPointData()->Initialize();
+        
+        if ( !spare || spare->GetDataType() != type || spare->GetNumberOfComponents() != components
+             || spare->GetSize() < tuples * components || spare->GetReferenceCount() > 1 )
+        {
+            spare.TakeReference( NewPooledArray( type, components, tuples ) );
+        }
+        else
+        {
+            // Never shrinks the allocation, so this doesn't touch the heap
+            spare->SetNumberOfTuples( tuples );
+        }
+        out->GetPointData()->SetScalars( spare );
+    }
+}
+
+void vtkPooledImageReslice::AllocateOutputData(vtkImageData *out, vtkInformation *outInfo, int *uExtent)
+{
+    AllocatePooledOutputData( this->SpareScalars, out, outInfo, uExtent );
+}
+
+void vtkPooledImageMapToColors::AllocateOutputData(vtkImageData *out, vtkInformation *outInfo, int *uExtent)
+{
+    AllocatePooledOutputData( this->SpareScalars, out, outInfo, uExtent );
+}
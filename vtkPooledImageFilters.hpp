@@ -0,0 +1,64 @@
+//
+//  vtkPooledImageFilters.hpp
+//  ImageSlicing
+//
+//  Created by Tom on 27/08/2016.
+//
+//
+
+#ifndef vtkPooledImageFilters_hpp
+#define vtkPooledImageFilters_hpp
+
+#include "vtkDataArray.h"
+#include "vtkImageMapToColors.h"
+#include "vtkImageReslice.h"
+#include "vtkSmartPointer.h"
+
+// The pipeline throws away each filter's output scalars before every update (PrepareForNewData), so a plain
+// reslice/colour map allocates and frees a slice sized buffer on every mouse move. These versions keep hold
+// of the last scalars they made and write into them again when nobody else is using them, and any new ones
+// they do need come from VolumeBufferPool::GetGlobalPool().
+
+class vtkPooledImageReslice : public vtkImageReslice
+{
+public:
+    
+    static vtkPooledImageReslice *New();
+    vtkTypeMacro(vtkPooledImageReslice, vtkImageReslice);
+    
+protected:
+    
+    vtkPooledImageReslice() {};
+    
+    virtual void AllocateOutputData(vtkImageData *out, vtkInformation *outInfo, int *uExtent);
+    
+    vtkSmartPointer<vtkDataArray> SpareScalars;
+    
+private:
+    
+    vtkPooledImageReslice(const vtkPooledImageReslice&);
+    void operator=(const vtkPooledImageReslice&);
+};
+
+class vtkPooledImageMapToColors : public vtkImageMapToColors
+{
+public:
+    
+    static vtkPooledImageMapToColors *New();
+    vtkTypeMacro(vtkPooledImageMapToColors, vtkImageMapToColors);
+    
+protected:
+    
+    vtkPooledImageMapToColors() {};
+    
+    virtual void AllocateOutputData(vtkImageData *out, vtkInformation *outInfo, int *uExtent);
+    
+    vtkSmartPointer<vtkDataArray> SpareScalars;
+    
+private:
+    
+    vtkPooledImageMapToColors(const vtkPooledImageMapToColors&);
+    void operator=(const vtkPooledImageMapToColors&);
+};
+
+#endif /* vtkPooledImageFilters_hpp */